@@ -0,0 +1,65 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURDetectionScheduler.h"
+
+// Weight of the newest measurement in the average detection time
+static const double AVERAGE_WEIGHT = 0.1;
+
+FAURDetectionScheduler::FAURDetectionScheduler()
+	: DetectionInterval(1)
+	, FramesSinceDetection(0)
+	, DetectionTimeAverage(-1.0)
+{
+}
+
+bool FAURDetectionScheduler::ShouldDetect(double time_now, float max_pose_speed, float max_rotation_speed, double last_loss_time)
+{
+	if (!Settings.bEnabled)
+	{
+		DetectionInterval = 1;
+		return true;
+	}
+
+	// Prediction is unreliable for fast motion and impossible for lost boards
+	if (max_pose_speed > Settings.FastMotionSpeed || max_rotation_speed > Settings.FastRotationSpeed)
+	{
+		return true;
+	}
+
+	if (last_loss_time >= 0 && time_now - last_loss_time < Settings.LossRecoveryTime)
+	{
+		return true;
+	}
+
+	return FramesSinceDetection + 1 >= DetectionInterval;
+}
+
+void FAURDetectionScheduler::OnDetection(double detection_time)
+{
+	FramesSinceDetection = 0;
+
+	DetectionTimeAverage = DetectionTimeAverage < 0 ? detection_time
+		: FMath::Lerp(DetectionTimeAverage, detection_time, AVERAGE_WEIGHT);
+
+	const int32 needed_interval = FMath::CeilToInt(DetectionTimeAverage * 1000.0 / FMath::Max(1.0f, Settings.DetectionBudgetMs));
+	DetectionInterval = FMath::Clamp(needed_interval, 1, FMath::Max(1, Settings.MaxDetectionInterval));
+}
+
+void FAURDetectionScheduler::OnFrameSkipped()
+{
+	FramesSinceDetection++;
+}
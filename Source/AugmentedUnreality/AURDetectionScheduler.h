@@ -0,0 +1,97 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AURDetectionScheduler.generated.h"
+
+USTRUCT(BlueprintType)
+struct FAURDetectionSchedulingSettings
+{
+	GENERATED_BODY()
+
+	// Run marker detection only on some frames when it does not fit in the budget, predict poses on the others
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bEnabled;
+
+	// Average time per frame (milliseconds) which detection may use
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float DetectionBudgetMs;
+
+	// Detection runs at least on every N-th frame
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "1", UIMin = "1"))
+	int32 MaxDetectionInterval;
+
+	// Detect on every frame while a board or the camera moves faster than this (units/s)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float FastMotionSpeed;
+
+	// Detect on every frame while a board or the camera rotates faster than this (degrees/s), for example when the camera pans in place
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float FastRotationSpeed;
+
+	// Detect on every frame for this long (seconds) after a board was lost
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float LossRecoveryTime;
+
+	FAURDetectionSchedulingSettings()
+		: bEnabled(false)
+		, DetectionBudgetMs(15.0)
+		, MaxDetectionInterval(4)
+		, FastMotionSpeed(50.0)
+		, FastRotationSpeed(90.0)
+		, LossRecoveryTime(0.5)
+	{
+	}
+};
+
+/*
+	Decides on which frames marker detection runs.
+	The interval N is chosen so that the average detection time per frame (detection time / N) fits in the budget.
+	Not thread safe - used only by the driver's worker thread.
+*/
+class FAURDetectionScheduler
+{
+public:
+	FAURDetectionScheduler();
+
+	void SetSettings(FAURDetectionSchedulingSettings const& settings)
+	{
+		Settings = settings;
+	}
+
+	// max_pose_speed, max_rotation_speed and last_loss_time as reported by the tracker
+	bool ShouldDetect(double time_now, float max_pose_speed, float max_rotation_speed, double last_loss_time);
+
+	void OnDetection(double detection_time);
+	void OnFrameSkipped();
+
+	// Detection runs on every N-th frame
+	int32 GetDetectionInterval() const
+	{
+		return DetectionInterval;
+	}
+
+protected:
+	FAURDetectionSchedulingSettings Settings;
+
+	int32 DetectionInterval;
+	int32 FramesSinceDetection;
+
+	// Running average of the duration of detection (seconds), negative if not measured yet
+	double DetectionTimeAverage;
+};
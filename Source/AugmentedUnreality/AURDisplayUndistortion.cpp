@@ -0,0 +1,187 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURDisplayUndistortion.h"
+#include "AURLog.h"
+#include "AURThreading.h"
+
+// Tables kept for resolutions used before, including the current one
+static const int32 MAX_CACHED_TABLES = 3;
+
+// Rows remapped at once, the intermediate BGR band stays in cache
+static const int32 BAND_ROWS = 16;
+
+FAURDisplayUndistortion::FAURDisplayUndistortion()
+	: bPropertiesChanged(false)
+{
+}
+
+void FAURDisplayUndistortion::SetCameraProperties(FOpenCVCameraProperties const& camera_properties)
+{
+	FScopeLock lock(&PropertiesLock);
+
+	// cv::Mat assignment would share the data with the caller
+	PendingProperties = camera_properties;
+	PendingProperties.CameraMatrix = camera_properties.CameraMatrix.clone();
+	PendingProperties.DistortionCoefficients = camera_properties.DistortionCoefficients.clone();
+	bPropertiesChanged = true;
+}
+
+cv::Mat_<double> FAURDisplayUndistortion::GetSourceCameraMatrix(FIntPoint const& source_resolution) const
+{
+	cv::Mat_<double> source_camera_matrix = CameraProperties.CameraMatrix.clone();
+	source_camera_matrix.row(0) *= double(source_resolution.X) / CameraProperties.Resolution.X;
+	source_camera_matrix.row(1) *= double(source_resolution.Y) / CameraProperties.Resolution.Y;
+	return source_camera_matrix;
+}
+
+FAURDisplayUndistortion::FRemapTables const* FAURDisplayUndistortion::GetTables(FIntPoint const& source_resolution, FIntPoint const& dest_resolution)
+{
+	{
+		FScopeLock lock(&PropertiesLock);
+		if (bPropertiesChanged)
+		{
+			CameraProperties = PendingProperties;
+			bPropertiesChanged = false;
+			Tables.Empty();
+		}
+	}
+
+	if (CameraProperties.CameraMatrix.empty() || CameraProperties.DistortionCoefficients.empty()
+		|| CameraProperties.Resolution.GetMin() <= 0)
+	{
+		return nullptr;
+	}
+
+	const int32 cached_idx = Tables.IndexOfByPredicate([&](FRemapTables const& tables) {
+		return tables.SourceResolution == source_resolution && tables.DestResolution == dest_resolution;
+	});
+
+	if (cached_idx != INDEX_NONE)
+	{
+		return &Tables[cached_idx];
+	}
+
+	const cv::Mat_<double> source_camera_matrix = GetSourceCameraMatrix(source_resolution);
+
+	// The displayed image uses the same pinhole camera as the tracker, at the display resolution
+	cv::Mat_<double> dest_camera_matrix = source_camera_matrix.clone();
+	dest_camera_matrix.row(0) *= double(dest_resolution.X) / source_resolution.X;
+	dest_camera_matrix.row(1) *= double(dest_resolution.Y) / source_resolution.Y;
+
+	FRemapTables tables;
+	tables.SourceResolution = source_resolution;
+	tables.DestResolution = dest_resolution;
+
+#if !PLATFORM_ANDROID
+	try
+	{
+#endif
+		cv::Mat map_x, map_y;
+		cv::initUndistortRectifyMap(source_camera_matrix, CameraProperties.DistortionCoefficients, cv::noArray(),
+			dest_camera_matrix, cv::Size(dest_resolution.X, dest_resolution.Y), CV_32FC1, map_x, map_y);
+
+		// Fixed-point tables are faster to apply than float coordinates
+		cv::convertMaps(map_x, map_y, tables.Map1, tables.Map2, CV_16SC2);
+#if !PLATFORM_ANDROID
+	}
+	catch (std::exception& exc)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURDisplayUndistortion: Failed to build remap tables:\n    %s"), UTF8_TO_TCHAR(exc.what()))
+		return nullptr;
+	}
+#endif
+
+	UE_LOG(LogAUR, Log, TEXT("FAURDisplayUndistortion: Remap tables for %dx%d -> %dx%d"),
+		source_resolution.X, source_resolution.Y, dest_resolution.X, dest_resolution.Y)
+
+	if (Tables.Num() >= MAX_CACHED_TABLES)
+	{
+		Tables.RemoveAt(0);
+	}
+	return &Tables[Tables.Add(tables)];
+}
+
+bool FAURDisplayUndistortion::ConvertBGRToColorUndistorted(cv::Mat_<cv::Vec3b> const& src, FIntPoint const& dest_resolution, FColor* dest)
+{
+	FRemapTables const* tables = GetTables(FIntPoint(src.cols, src.rows), dest_resolution);
+	if (!tables)
+	{
+		return false;
+	}
+
+	const int32 num_bands = (dest_resolution.Y + BAND_ROWS - 1) / BAND_ROWS;
+
+	FAURThreading::ParallelFor(num_bands, [&](int32 bands_begin, int32 bands_end) {
+		cv::Mat_<cv::Vec3b> band;
+
+		for (int32 band_idx = bands_begin; band_idx < bands_end; band_idx++)
+		{
+			const int32 row_begin = band_idx * BAND_ROWS;
+			const int32 row_end = FMath::Min(row_begin + BAND_ROWS, dest_resolution.Y);
+
+			// The tables of a band of output rows refer to any rows of the source
+			cv::remap(src, band, tables->Map1.rowRange(row_begin, row_end), tables->Map2.rowRange(row_begin, row_end),
+				cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+
+			FAUROpenCV::ConvertBGRToColor(band, dest + int64(row_begin) * dest_resolution.X);
+		}
+	});
+
+	return true;
+}
+
+void FAURDisplayUndistortion::UndistortOverlay(FIntPoint const& source_resolution, FAURFrameOverlay& overlay) const
+{
+	if (overlay.IsEmpty() || CameraProperties.CameraMatrix.empty() || CameraProperties.DistortionCoefficients.empty()
+		|| CameraProperties.Resolution.GetMin() <= 0)
+	{
+		return;
+	}
+
+	const FVector2D source_size(source_resolution.X, source_resolution.Y);
+
+	std::vector<cv::Point2f> distorted_points;
+	overlay.ForEachPoint([&](FVector2D& pt) {
+		const FVector2D px = pt * source_size;
+		distorted_points.push_back(cv::Point2f(px.X, px.Y));
+	});
+
+	// The display camera is the source camera scaled, so relative coordinates are the same in both
+	const cv::Mat_<double> source_camera_matrix = GetSourceCameraMatrix(source_resolution);
+	std::vector<cv::Point2f> undistorted_points;
+
+#if !PLATFORM_ANDROID
+	try
+	{
+#endif
+		cv::undistortPoints(distorted_points, undistorted_points, source_camera_matrix, CameraProperties.DistortionCoefficients,
+			cv::noArray(), source_camera_matrix);
+#if !PLATFORM_ANDROID
+	}
+	catch (std::exception& exc)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURDisplayUndistortion: Failed to undistort the overlay:\n    %s"), UTF8_TO_TCHAR(exc.what()))
+		return;
+	}
+#endif
+
+	int32 point_idx = 0;
+	overlay.ForEachPoint([&](FVector2D& pt) {
+		cv::Point2f const& undistorted = undistorted_points[point_idx++];
+		pt = FVector2D(undistorted.x, undistorted.y) / source_size;
+	});
+}
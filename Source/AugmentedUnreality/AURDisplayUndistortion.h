@@ -0,0 +1,68 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AUROpenCV.h"
+#include "AUROpenCVCalibration.h"
+#include "AURFrameOverlay.h"
+
+/*
+	Converts captured frames to the displayed FColor image with the lens distortion removed,
+	so that the video matches the pinhole model used for tracking.
+
+	The remap tables (fixed-point, as produced by cv::convertMaps) are computed once
+	for each pair of capture and display resolutions and kept until the camera properties change.
+	Frames are then remapped and converted in bands of rows, in parallel, without per-pixel projection math.
+*/
+class FAURDisplayUndistortion
+{
+public:
+	FAURDisplayUndistortion();
+
+	// Thread safe, the tables are rebuilt on the next conversion
+	void SetCameraProperties(FOpenCVCameraProperties const& camera_properties);
+
+	// dest must have room for dest_resolution pixels. Returns false if there is no calibration to undistort with.
+	bool ConvertBGRToColorUndistorted(cv::Mat_<cv::Vec3b> const& src, FIntPoint const& dest_resolution, FColor* dest);
+
+	// Move the overlay of a captured frame to the positions in the undistorted image, after a successful conversion
+	void UndistortOverlay(FIntPoint const& source_resolution, FAURFrameOverlay& overlay) const;
+
+protected:
+	struct FRemapTables
+	{
+		FIntPoint SourceResolution;
+		FIntPoint DestResolution;
+		// CV_16SC2 integer source coordinates and CV_16UC1 interpolation weights index
+		cv::Mat Map1;
+		cv::Mat Map2;
+	};
+
+	FCriticalSection PropertiesLock;
+	FOpenCVCameraProperties PendingProperties;
+	bool bPropertiesChanged;
+
+	// Used only by the converting thread
+	FOpenCVCameraProperties CameraProperties;
+	TArray<FRemapTables> Tables;
+
+	FRemapTables const* GetTables(FIntPoint const& source_resolution, FIntPoint const& dest_resolution);
+
+	// The calibration may be for another resolution with the same aspect, scale the camera matrix to the source
+	cv::Mat_<double> GetSourceCameraMatrix(FIntPoint const& source_resolution) const;
+};
@@ -18,6 +18,9 @@ limitations under the License.
 #include "AURDriver.h"
 #include "tracking/AURFiducialPattern.h"
 
+// Texture rings kept for switching back to a previous resolution, besides the current one
+static const int32 MAX_CACHED_TEXTURE_RESOLUTIONS = 2;
+
 UAURDriver* UAURDriver::CurrentDriver = nullptr;
 UAURDriver::FAURDriverInstanceChange UAURDriver::OnDriverInstanceChange;
 TArray<UAURDriver::BoardRegistration> UAURDriver::RegisteredBoards;
@@ -26,8 +29,16 @@ UAURDriver::UAURDriver()
 	: bPerformOrientationTracking(true)
 	, DiagnosticLevel(EAURDiagnosticInfoLevel::AURD_Silent)
 	, bActive(false)
+	, DisplayScale(1.0)
+	, OutputTextureCount(1)
 	, FrameResolution(1, 1)
+	, DisplayResolution(1, 1)
 	, bCalibrationInProgress(false)
+	, NextOutputTextureIndex(0)
+	, bOutputTextureOutdated(true)
+	, UploadedFrameSequenceNumber(0)
+	, bHasFrameConsumers(false)
+	, bWarnedNoFrameConsumers(false)
 {
 }
 
@@ -60,7 +71,13 @@ void UAURDriver::Tick()
 {
 	if (this->bActive)
 	{
-		this->WriteFrameToTexture();
+		UpdateFrameConsumers();
+
+		// Tracking only - nothing to draw
+		if (HasFrameConsumers())
+		{
+			this->WriteFrameToTexture();
+		}
 	}
 	else
 	{
@@ -79,63 +96,93 @@ void UAURDriver::WriteFrameToTexture()
 	**/
 	//******************************************************************************************************************************
 
-	FTexture2DResource*	tex_resource = Texture2DResource;
-	FUpdateTextureRegion2D region_def = RegionDefinition;
+	// Upload only if a new frame has been captured
+	FAURVideoFrameHandle new_video_frame = GetFrameHandle();
+	if (!new_video_frame.IsValid() || new_video_frame->SequenceNumber == UploadedFrameSequenceNumber)
+	{
+		TextureUploadStats.UploadsSkipped++;
+		return;
+	}
 
+	FUpdateTextureRegion2D region_def;
+	UTexture2D* target_texture;
+	{
+		// The ring may be replaced by the capture thread on a resolution change
+		FScopeLock lock(&OutputTextureLock);
+
+		// The frame may have been captured before a resolution change
+		if (OutputTextureRing.Num() == 0 || new_video_frame->FrameResolution != FIntPoint(RegionDefinition.Width, RegionDefinition.Height))
+		{
+			TextureUploadStats.UploadsSkipped++;
+			return;
+		}
+
+		region_def = RegionDefinition;
+
+		// Write the oldest texture of the ring, the GPU has had the longest time to finish reading it
+		NextOutputTextureIndex = NextOutputTextureIndex % OutputTextureRing.Num();
+		target_texture = OutputTextureRing[NextOutputTextureIndex];
+		NextOutputTextureIndex++;
+	}
+
+	// Frames published between two ticks are never uploaded
+	if (UploadedFrameSequenceNumber > 0 && new_video_frame->SequenceNumber > UploadedFrameSequenceNumber + 1)
+	{
+		TextureUploadStats.FramesCoalesced += new_video_frame->SequenceNumber - UploadedFrameSequenceNumber - 1;
+	}
+	UploadedFrameSequenceNumber = new_video_frame->SequenceNumber;
+	DisplayedFrameOverlay = new_video_frame->Overlay;
+
+	FTexture2DResource* tex_resource = (FTexture2DResource*)target_texture->Resource;
+
+	// The render command holds its own reference to the frame, so the capture thread
+	// can publish further frames while this one is being uploaded.
 	ENQUEUE_RENDER_COMMAND(UpdateTextureRenderCommand)(
-		[this, tex_resource, region_def] (FRHICommandListImmediate& RHICmdList) {
+		[tex_resource, region_def, new_video_frame] (FRHICommandListImmediate& RHICmdList) {
 			if (tex_resource 
 					&& tex_resource->GetCurrentFirstMip() <= 0 
 					&& tex_resource->GetTexture2DRHI())
 			{
-				// Re-draw only if a new frame has been captured
-				//if (UpdateParameters->Driver && UpdateParameters->Driver->IsNewFrameAvailable())
-				if (this && this->IsNewFrameAvailable())
-				{
-					FAURVideoFrame* new_video_frame = this->GetFrame();
-
-					// If the driver was shut down, it will return null
-					// better print an error than make the whole program disappear mysteriously
-					if (new_video_frame)
-					{
-						/**
-						Function signature, https://docs.unrealengine.com/latest/INT/API/Runtime/OpenGLDrv/FOpenGLDynamicRHI/RHIUpdateTexture2D/index.html
-
-						virtual void RHIUpdateTexture2D
-						(
-						FTexture2DRHIParamRef Texture,
-						uint32 MipIndex,
-						const struct FUpdateTextureRegion2D & UpdateRegion,
-						uint32 SourcePitch,
-						const uint8 * SourceData
-						)
-						**/
-						RHIUpdateTexture2D(
-							tex_resource->GetTexture2DRHI(),
-							0,
-							region_def,
-							sizeof(FColor) * region_def.Width, // width of the video in bytes
-							new_video_frame->GetDataPointerRaw()
-						);
-					}
-					else
-					{
-						UE_LOG(LogAUR, Error, TEXT("UAURDriver::WriteFrameToTexture null frame returned. It has probably been shut down."));
-					}
-				}
-				else
-				{
-					//UE_LOG(LogAUR, Log, TEXT("UAURDriver::WriteFrameToTexture No frame ready"));
-				}
+				/**
+				Function signature, https://docs.unrealengine.com/latest/INT/API/Runtime/OpenGLDrv/FOpenGLDynamicRHI/RHIUpdateTexture2D/index.html
+
+				virtual void RHIUpdateTexture2D
+				(
+				FTexture2DRHIParamRef Texture,
+				uint32 MipIndex,
+				const struct FUpdateTextureRegion2D & UpdateRegion,
+				uint32 SourcePitch,
+				const uint8 * SourceData
+				)
+				**/
+				RHIUpdateTexture2D(
+					tex_resource->GetTexture2DRHI(),
+					0,
+					region_def,
+					sizeof(FColor) * region_def.Width, // width of the video in bytes
+					new_video_frame->GetDataPointerRaw()
+				);
 			}
 			else
 			{
 				//UE_LOG(LogAUR, Log, TEXT("UAURDriver::WriteFrameToTexture No texture"));
 			}
-		// We do not delete anything, because the region structures we use are members of the class,
-		// and the frames belong to the driver.
+		// The frame returns to the driver's pool when the lambda holding the handle is destroyed
 		}
 	);
+
+	TextureUploadStats.UploadsIssued++;
+
+	// Render commands execute in order, so the material parameter set after this
+	// reaches the render thread only when the upload is done
+	if (target_texture != OutputTexture)
+	{
+		{
+			FScopeLock lock(&OutputTextureLock);
+			OutputTexture = target_texture;
+		}
+		OnOutputTextureChange.Broadcast(this);
+	}
 }
 
 void UAURDriver::Shutdown()
@@ -252,6 +299,11 @@ FAURVideoFrame * UAURDriver::GetFrame()
 	return nullptr;
 }
 
+FAURVideoFrameHandle UAURDriver::GetFrameHandle()
+{
+	return FAURVideoFrameHandle();
+}
+
 bool UAURDriver::IsNewFrameAvailable() const
 {
 	return false;
@@ -273,21 +325,106 @@ FString UAURDriver::GetDiagnosticText() const
 	return "Not implemented";
 }
 
+void UAURDriver::BroadcastPoseBatch()
+{
+	if (PoseBatch.Num() > 0)
+	{
+		OnPoseBatchUpdate.Broadcast(this, PoseBatch);
+	}
+}
+
+void UAURDriver::DrawFrameOverlay(UCanvas* Canvas, FVector2D ScreenPosition, FVector2D ScreenSize) const
+{
+	DisplayedFrameOverlay.Draw(Canvas, ScreenPosition, ScreenSize);
+}
+
 void UAURDriver::SetFrameResolution(FIntPoint const & new_res)
 {
-	if (new_res.GetMin() <= 0)
 	{
-		UE_LOG(LogAUR, Error, TEXT("UAURDriver::SetFrameResolution: invalid resolution %d x %d"), new_res.X, new_res.Y);
-		this->FrameResolution = FIntPoint(1, 1);
+		FScopeLock lock(&OutputTextureLock);
+
+		if (new_res.GetMin() <= 0)
+		{
+			UE_LOG(LogAUR, Error, TEXT("UAURDriver::SetFrameResolution: invalid resolution %d x %d"), new_res.X, new_res.Y);
+			this->FrameResolution = FIntPoint(1, 1);
+		}
+		else
+		{
+			this->FrameResolution = new_res;
+		}
+
+		const float scale = FMath::Clamp(DisplayScale, 0.05f, 1.0f);
+		this->DisplayResolution = FIntPoint(
+			FMath::Max(1, FMath::RoundToInt(FrameResolution.X * scale)),
+			FMath::Max(1, FMath::RoundToInt(FrameResolution.Y * scale))
+		);
+
+		bOutputTextureOutdated = true;
 	}
-	else
+
+	// Without consumers the texture is created when the first one appears
+	if (HasFrameConsumers())
 	{
-		this->FrameResolution = new_res;
+		UpdateOutputTexture();
 	}
+}
 
-	// Create transient texture to be able to draw on it
-	this->OutputTexture = UTexture2D::CreateTransient(this->FrameResolution.X, this->FrameResolution.Y);
-	this->OutputTexture->UpdateResource();
+void UAURDriver::SetDisplayScale(float NewDisplayScale)
+{
+	if (NewDisplayScale != DisplayScale)
+	{
+		DisplayScale = NewDisplayScale;
+
+		// Reallocate the frames and texture, and let the screens pick up the new texture
+		SetFrameResolution(FrameResolution);
+		OnVideoPropertiesChange.Broadcast(this);
+	}
+}
+
+void UAURDriver::UpdateOutputTexture()
+{
+	FScopeLock lock(&OutputTextureLock);
+
+	if (!bOutputTextureOutdated)
+	{
+		return;
+	}
+	bOutputTextureOutdated = false;
+
+	// The textures of the previous resolution may be used again later
+	CachedOutputTextures.Append(OutputTextureRing);
+	OutputTextureRing.Empty();
+
+	const int32 ring_size = FMath::Clamp(OutputTextureCount, 1, 4);
+	for (int32 idx = 0; idx < ring_size; idx++)
+	{
+		const int32 cached_idx = CachedOutputTextures.IndexOfByPredicate([&](UTexture2D* texture) {
+			return texture && texture->GetSizeX() == DisplayResolution.X && texture->GetSizeY() == DisplayResolution.Y;
+		});
+
+		if (cached_idx != INDEX_NONE)
+		{
+			OutputTextureRing.Add(CachedOutputTextures[cached_idx]);
+			CachedOutputTextures.RemoveAt(cached_idx);
+		}
+		else
+		{
+			// Create transient texture to be able to draw on it
+			UTexture2D* texture = UTexture2D::CreateTransient(this->DisplayResolution.X, this->DisplayResolution.Y);
+			texture->UpdateResource();
+			OutputTextureRing.Add(texture);
+		}
+	}
+
+	// Oldest first
+	while (CachedOutputTextures.Num() > MAX_CACHED_TEXTURE_RESOLUTIONS * ring_size)
+	{
+		CachedOutputTextures.RemoveAt(0);
+	}
+
+	// The first upload goes to the texture after the displayed one
+	this->OutputTexture = OutputTextureRing[0];
+	NextOutputTextureIndex = 1;
 
 	/**
 	To make a dynamic texture update, we need to specify the texture region which is being updated.
@@ -305,16 +442,64 @@ void UAURDriver::SetFrameResolution(FIntPoint const & new_res)
 	whole_texture_region.DestX = 0;
 	whole_texture_region.DestY = 0;
 
-	// Size of the updated region equals to the size of video image
-	whole_texture_region.Width = FrameResolution.X;
-	whole_texture_region.Height = FrameResolution.Y;
+	// Size of the updated region equals to the size of the displayed image
+	whole_texture_region.Width = DisplayResolution.X;
+	whole_texture_region.Height = DisplayResolution.Y;
 
-	// The AVideoDisplaySurface::FTextureUpdateParameters struct
-	// holds information sent from this class to the render thread.
-	this->Texture2DResource = (FTexture2DResource*)this->OutputTexture->Resource;
 	this->RegionDefinition = whole_texture_region;
 }
 
+void UAURDriver::AddFrameConsumer(UObject* Consumer)
+{
+	if (!Consumer)
+	{
+		return;
+	}
+
+	FrameConsumers.AddUnique(Consumer);
+
+	if (!bHasFrameConsumers)
+	{
+		// The texture has to exist before the consumer asks for it
+		bHasFrameConsumers.AtomicSet(true);
+		UpdateOutputTexture();
+		OnFrameConsumersChange();
+	}
+}
+
+void UAURDriver::RemoveFrameConsumer(UObject* Consumer)
+{
+	FrameConsumers.Remove(Consumer);
+	UpdateFrameConsumers();
+}
+
+void UAURDriver::WarnIfNoFrameConsumers(const TCHAR* function_name) const
+{
+	if (!HasFrameConsumers() && !bWarnedNoFrameConsumers.AtomicSet(true))
+	{
+		UE_LOG(LogAUR, Warning, TEXT("UAURDriver::%s: called without frame consumers, the video is not produced - call AddFrameConsumer first"),
+			function_name)
+	}
+}
+
+void UAURDriver::UpdateFrameConsumers()
+{
+	FrameConsumers.RemoveAll([](TWeakObjectPtr<UObject> const& consumer) {
+		return !consumer.IsValid();
+	});
+
+	if (bHasFrameConsumers && FrameConsumers.Num() == 0)
+	{
+		UE_LOG(LogAUR, Log, TEXT("UAURDriver: No frame consumers, switching to tracking only"))
+		bHasFrameConsumers.AtomicSet(false);
+		OnFrameConsumersChange();
+	}
+}
+
+void UAURDriver::OnFrameConsumersChange()
+{
+}
+
 UAURDriver * UAURDriver::GetCurrentDriver()
 {
 	return CurrentDriver;
@@ -17,6 +17,8 @@ limitations under the License.
 #pragma once
 
 #include "video_sources/AURVideoSource.h"
+#include "AURFrameOverlay.h"
+#include "AURPoseBatch.h"
 #include "HAL/PlatformFilemanager.h"
 #include "AURDriver.generated.h"
 
@@ -41,21 +43,36 @@ struct FAURVideoFrame
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
 	TArray<FColor> Image;
 
+	// Increases with each frame published by the driver
+	int64 SequenceNumber;
+
+	// FPlatformTime::Seconds() when the frame was published
+	double Timestamp;
+
+	// Detections in this frame, filled at the advanced diagnostic level and during calibration
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	FAURFrameOverlay Overlay;
+
 	FAURVideoFrame()
+		: SequenceNumber(0)
+		, Timestamp(0)
 	{
 		this->SetResolution(FIntPoint(1280, 720));
 	}
 
 	FAURVideoFrame(FIntPoint resolution)
 		: FrameResolution(resolution)
+		, SequenceNumber(0)
+		, Timestamp(0)
 	{
 		this->SetResolution(resolution);
 	}
 
+	// The content is undefined after a change of resolution, the memory is only allocated
 	void SetResolution(FIntPoint resolution)
 	{
 		this->FrameResolution = resolution;
-		this->Image.Init(FColor::MakeRandomColor(), this->GetImageSize());
+		this->Image.SetNumUninitialized(this->GetImageSize(), false);
 	}
 
 	/**
@@ -72,6 +89,39 @@ struct FAURVideoFrame
 	}
 };
 
+// Counters of the texture upload path, measured on the game thread, so they also work with -nullrhi
+USTRUCT(BlueprintType)
+struct FAURTextureUploadStats
+{
+	GENERATED_BODY()
+
+	// Render commands enqueued to upload a frame
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 UploadsIssued;
+
+	// Ticks on which there was no new frame to upload
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 UploadsSkipped;
+
+	// Frames published by the capture thread but replaced by a newer one before they could be uploaded
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 FramesCoalesced;
+
+	FAURTextureUploadStats()
+		: UploadsIssued(0)
+		, UploadsSkipped(0)
+		, FramesCoalesced(0)
+	{
+	}
+};
+
+/**
+ * Shared reference to a frame from the driver's pool.
+ * The frame data does not change while a handle is held,
+ * the frame goes back to the pool when the last handle is released.
+ */
+typedef TSharedPtr<FAURVideoFrame, ESPMode::ThreadSafe> FAURVideoFrameHandle;
+
 /**
  * Represents a way of connecting to a camera.
  */
@@ -86,11 +136,16 @@ public:
 	DECLARE_DYNAMIC_DELEGATE_OneParam(FAURDriverInstanceChangeSingle, UAURDriver*, Driver);
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FAURDriverInstanceChange, UAURDriver*, Driver);
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FAURDriverViewpointTransformUpdate, UAURDriver*, Driver, FTransform, ViewportTransform);
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FAURDriverPoseBatchUpdate, UAURDriver*, Driver, FAURPoseBatch const&, Batch);
 
 	/** Called when the resolution / FOV changes / connection status changes */
 	UPROPERTY(BlueprintAssignable)
 	FAURDriverVideoPropertiesChange OnVideoPropertiesChange;
 
+	/** Called when OutputTexture is switched to the next texture of the ring, after a new frame was uploaded to it */
+	UPROPERTY(BlueprintAssignable)
+	FAURDriverVideoPropertiesChange OnOutputTextureChange;
+
 	/** Called when calibration starts or ends */
 	UPROPERTY(BlueprintAssignable)
 	FAURDriverCalibrationStatusChange OnCalibrationStatusChange;
@@ -99,10 +154,55 @@ public:
 	UPROPERTY(BlueprintAssignable)
 	FAURDriverViewpointTransformUpdate OnViewpointTransformUpdate;
 
+	/**
+	 * Called once per tick with all board poses updated in that tick.
+	 * Cheaper than binding AAURFiducialPattern::OnTransformUpdate of many boards.
+	 */
+	UPROPERTY(BlueprintAssignable)
+	FAURDriverPoseBatchUpdate OnPoseBatchUpdate;
+
+	// Board poses published in the last tick
+	FAURPoseBatch const& GetPoseBatch() const
+	{
+		return PoseBatch;
+	}
+
 	/** True if it should track markers and calculate camera position+rotation */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
 	uint32 bPerformOrientationTracking : 1;
 
+	/**
+	 * Size of OutputTexture relative to the captured video, for screens which do not need full resolution.
+	 * Lowers the cost of conversion and texture upload, detection still uses the full resolution.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = AugmentedReality, meta = (ClampMin = "0.05", ClampMax = "1.0", UIMin = "0.05", UIMax = "1.0"))
+	float DisplayScale;
+
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	void SetDisplayScale(float NewDisplayScale);
+
+	/**
+	 * Frames are uploaded to this many textures in turn, so that an upload never writes
+	 * the texture the GPU may still be reading. OutputTexture always points to the newest one.
+	 * With more than 1, OutputTexture changes on every frame: consumers have to bind it again
+	 * in OnOutputTextureChange, as UAURVideoScreenBase does. With 1, it only changes with the resolution.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = AugmentedReality, meta = (ClampMin = "1", ClampMax = "4", UIMin = "1", UIMax = "4"))
+	int32 OutputTextureCount;
+
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	FAURTextureUploadStats GetTextureUploadStats() const
+	{
+		return TextureUploadStats;
+	}
+
+	// Resolution of OutputTexture and of the frames returned by GetFrame
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	FIntPoint GetDisplayResolution() const
+	{
+		return DisplayResolution;
+	}
+
 	// Automatically creates those video sources on Initialize
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = AugmentedReality)
 	TArray< TSubclassOf<UAURVideoSource> > AvailableVideoSources;
@@ -160,12 +260,35 @@ public:
 	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	virtual void Shutdown();
 
+	/**
+	 * Texture showing the video. It is created and updated only while there are frame consumers,
+	 * see AddFrameConsumer, otherwise it is null or stale.
+	 */
 	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	UTexture2D* GetOutputTexture() const
 	{
+		WarnIfNoFrameConsumers(TEXT("GetOutputTexture"));
 		return OutputTexture;
 	}
 
+	/**
+	 * Objects which display or read the video register themselves here.
+	 * Without consumers the driver only tracks markers: frames are not converted
+	 * and the output texture is neither allocated nor updated.
+	 */
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	void AddFrameConsumer(UObject* Consumer);
+
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	void RemoveFrameConsumer(UObject* Consumer);
+
+	// Safe to call from the capture thread
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	bool HasFrameConsumers() const
+	{
+		return bHasFrameConsumers;
+	}
+
 	// Is the camera connected and working.
 	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	virtual bool IsConnected() const;
@@ -219,9 +342,18 @@ public:
 	 * Call this again to get a pointer to the new frame.
 	 * THE EXISTING FRAME POINTER BECOMES INVALID WHEN GetFrame IS CALLED (it may be processed by other thread).
 	 * If you need to store the data, copy it before GetFrame().
+	 * Frames are only produced while there are frame consumers, see AddFrameConsumer.
 	 */
 	virtual FAURVideoFrame* GetFrame();
 
+	/**
+	 * Returns the newest frame without copying it, or null if no frame has been captured yet.
+	 * Unlike GetFrame, the handle stays valid as long as it is held and can be used from any thread,
+	 * so several consumers can keep frames at the same time.
+	 * Frames are only produced while there are frame consumers, see AddFrameConsumer.
+	 */
+	virtual FAURVideoFrameHandle GetFrameHandle();
+
 	/**
 	 * @returns true if a new frame has been captured since the last GetFrame() call.
 	 */
@@ -243,6 +375,20 @@ public:
 	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	virtual FString GetDiagnosticText() const;
 
+	// Detections in the frame currently shown in OutputTexture, the video itself is never drawn on
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	FAURFrameOverlay GetFrameOverlay() const
+	{
+		return DisplayedFrameOverlay;
+	}
+
+	/**
+	 * Draw GetFrameOverlay on a canvas, for example in the HUD's DrawHUD event.
+	 * ScreenPosition and ScreenSize: the rectangle of the canvas in which the video is shown.
+	 */
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	void DrawFrameOverlay(UCanvas* Canvas, FVector2D ScreenPosition, FVector2D ScreenSize) const;
+
 	// Start tracking a board - called by the static board list mechanism (RegisterBoardForTracking)
 	virtual bool RegisterBoard(AAURFiducialPattern* board_actor, bool use_as_viewpoint_origin = false);
 
@@ -288,6 +434,24 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Transient, Category = AugmentedReality)
 	UTexture2D* OutputTexture;
 
+	// Textures the frames are uploaded to in turn, OutputTexture is the last written one
+	UPROPERTY(Transient)
+	TArray<UTexture2D*> OutputTextureRing;
+
+	// Textures of recently used resolutions, reused when switching back to them
+	UPROPERTY(Transient)
+	TArray<UTexture2D*> CachedOutputTextures;
+
+	// Overlay of the frame last uploaded to OutputTexture
+	FAURFrameOverlay DisplayedFrameOverlay;
+
+	// Filled by the tracker on each tick, broadcast by BroadcastPoseBatch
+	UPROPERTY(Transient)
+	FAURPoseBatch PoseBatch;
+
+	// Broadcast OnPoseBatchUpdate if any pose was published in this tick
+	void BroadcastPoseBatch();
+
 	// How much diagnostic information should be displayed. High value may reduce performance.
 	UPROPERTY(EditAnywhere, Category = AugmentedReality)
 	EAURDiagnosticInfoLevel DiagnosticLevel;
@@ -305,9 +469,12 @@ protected:
 	// Is the driver turned on
 	uint32 bActive : 1;
 
-	// Resolution of the frames used for image transfer
+	// Resolution of the captured frames
 	FIntPoint FrameResolution;
 
+	// Resolution of the frames used for image transfer, FrameResolution scaled by DisplayScale
+	FIntPoint DisplayResolution;
+
 	uint32 bCalibrationInProgress : 1;
 
 	/** Reference to UWorld for time measurement */
@@ -316,6 +483,9 @@ protected:
 	// Resizes output texture and frames to fit the resolution provided by video source
 	virtual void SetFrameResolution(FIntPoint const& new_res);
 
+	// Called on the game thread when the first consumer is added or the last one removed
+	virtual void OnFrameConsumersChange();
+
 	static void EnsureDirExists(FString FilePath)
 	{
 		IPlatformFile & filesystem = FPlatformFileManager::Get().GetPlatformFile();
@@ -325,9 +495,34 @@ protected:
 private:
 	// The rendering scheduled by ENQUEUE_UNIQUE_RENDER takes place in the rendering thread:
 	// https://docs.unrealengine.com/latest/INT/Programming/Rendering/ThreadedRendering/index.html
-	FTexture2DResource*	Texture2DResource;
 	FUpdateTextureRegion2D RegionDefinition;
-	
+	int32 NextOutputTextureIndex;
+
+	// The texture is created from the capture thread on resolution change or from the game thread when a consumer appears
+	FCriticalSection OutputTextureLock;
+	bool bOutputTextureOutdated;
+
+	// Game thread only, bHasFrameConsumers is read by the capture thread
+	TArray<TWeakObjectPtr<UObject>> FrameConsumers;
+	FThreadSafeBool bHasFrameConsumers;
+
+	// Video was requested without a registered consumer, which is only logged once
+	mutable FThreadSafeBool bWarnedNoFrameConsumers;
+
+	// Log once if video is read while no consumer is registered, so the video is not produced. Any thread.
+	void WarnIfNoFrameConsumers(const TCHAR* function_name) const;
+
+	// Switch to a texture of the current resolution if it has changed, cached or new
+	void UpdateOutputTexture();
+
+	// Remove consumers which were destroyed without unregistering
+	void UpdateFrameConsumers();
+
+	// Sequence number of the last frame sent to the texture
+	int64 UploadedFrameSequenceNumber;
+
+	FAURTextureUploadStats TextureUploadStats;
+
 	void WriteFrameToTexture();
 
 	// Global registry of boards to track
@@ -17,30 +17,97 @@ limitations under the License.
 #include "AURDriverOpenCV.h"
 #include "AURLog.h"
 
+// Capture buffers kept for resolutions used before the current one
+static const int32 MAX_CACHED_CAPTURE_BUFFERS = 2;
+
+// The video configuration status in the diagnostic text is refreshed at most this often (seconds), it is updated on the capture thread
+static const double STATUS_TEXT_INTERVAL = 0.5;
+
 UAURDriverOpenCV::UAURDriverOpenCV()
+	: bSynchronousMode(false)
+	, SynchronousFrameTime(1.0 / 30.0)
+	, bUndistortDisplay(false)
+	, CalibrationPattern(EAURCalibrationPattern::CirclesGrid)
+	, SwitchToNextVideoSource(false)
+	, bNextVideoConfigurationAutomatic(false)
+	, SynchronousFrameNumber(0)
 {
 }
 
 void UAURDriverOpenCV::Initialize(AActor* parent_actor)
 {
 	this->Tracker.SetSettings(this->TrackerSettings);
+	this->ConfigurationSelector.SetSettings(this->VideoAutoConfiguration);
+	this->DetectionScheduler.SetSettings(this->DetectionScheduling);
+	this->FrameProcessors.SetUseTaskGraph(Threading.bRunStagesOnTaskGraph);
+	DetectionInterval.Set(1);
+	SynchronousFrameNumber = 0;
 
 	//FAUROpenCV::SetGstreamerPluginEnv();
 
 	Tracker.SetBoardVisibility(DiagnosticLevel >= EAURDiagnosticInfoLevel::AURD_Basic);
 
 	Super::Initialize(parent_actor);
+
+	if (OutputStream.bEnabled)
+	{
+		StartOutputStream();
+	}
+
+	UpdateLateUpdateSettings();
+}
+
+void UAURDriverOpenCV::Shutdown()
+{
+	// Without a thread, the worker's cleanup is not run by the thread either
+	if (!UsesWorkerThread() && Worker.IsValid())
+	{
+		static_cast<FWorkerRunnable*>(Worker.Get())->Finish();
+	}
+
+	// Stops the worker, so no more frames are pushed to the output
+	Super::Shutdown();
+
+	StopOutputStream();
+
+	// Frames already being rendered keep their own reference
+	LateUpdateExtension.Reset();
 }
 
 void UAURDriverOpenCV::Tick()
 {
+	// One frame per tick, before the frame and poses are published below
+	if (bActive && !UsesWorkerThread() && Worker.IsValid())
+	{
+		SynchronousFrameNumber++;
+		static_cast<FWorkerRunnable*>(Worker.Get())->Step();
+	}
+
 	Super::Tick();
 
 	if (bActive)
 	{
 		// lock moved to AURArucoTracker
 		//FScopeLock lock(&this->TrackerLock);
-		Tracker.PublishTransformUpdatesOnTick(this);
+		PoseBatch.Reset();
+		Tracker.PublishTransformUpdatesOnTick(this, PoseBatch);
+		BroadcastPoseBatch();
+
+		UpdateLateUpdateSettings();
+	}
+}
+
+void UAURDriverOpenCV::UpdateLateUpdateSettings()
+{
+	// Created when first enabled, then kept until Shutdown - when disabled it only stays inactive
+	if (!LateUpdateExtension.IsValid() && LateUpdate.Mode != EAURLateUpdateMode::Disabled)
+	{
+		LateUpdateExtension = FSceneViewExtensions::NewExtension<FAURLateUpdateViewExtension>(this, &Tracker);
+	}
+
+	if (LateUpdateExtension.IsValid())
+	{
+		LateUpdateExtension->SetSettings(LateUpdate);
 	}
 }
 
@@ -58,6 +125,137 @@ void UAURDriverOpenCV::OpenVideoSource(FAURVideoConfiguration const& VideoConfig
 		FScopeLock lock(&VideoSourceLock);
 		NextVideoConfiguration = VideoConfiguration;
 		SwitchToNextVideoSource = true;
+		bNextVideoConfigurationAutomatic = false;
+	}
+}
+
+void UAURDriverOpenCV::RequestVideoConfiguration(FAURVideoConfiguration const& VideoConfiguration)
+{
+	FScopeLock lock(&VideoSourceLock);
+
+	// A switch requested by the user takes precedence
+	if (!SwitchToNextVideoSource)
+	{
+		NextVideoConfiguration = VideoConfiguration;
+		SwitchToNextVideoSource = true;
+		bNextVideoConfigurationAutomatic = true;
+	}
+}
+
+bool UAURDriverOpenCV::IsProbingVideoConfigurations() const
+{
+	return bProbingVideoConfigurations;
+}
+
+void UAURDriverOpenCV::StartOutputStream()
+{
+	StopOutputStream();
+
+	TSharedPtr<FAURVideoOutputSink, ESPMode::ThreadSafe> new_sink = MakeShareable(new FAURVideoOutputSink(OutputStream));
+
+	if (new_sink->Start())
+	{
+		FScopeLock lock(&OutputSinkLock);
+		OutputSink = new_sink;
+	}
+	else
+	{
+		UE_LOG(LogAUR, Error, TEXT("UAURDriverOpenCV::StartOutputStream: Failed to start the encoder thread"))
+	}
+}
+
+void UAURDriverOpenCV::StopOutputStream()
+{
+	TSharedPtr<FAURVideoOutputSink, ESPMode::ThreadSafe> old_sink;
+	{
+		FScopeLock lock(&OutputSinkLock);
+		old_sink = OutputSink;
+		OutputSink.Reset();
+	}
+
+	// Wait for the encoder outside the lock, so that the worker is not blocked
+	if (old_sink.IsValid())
+	{
+		old_sink->Shutdown();
+	}
+}
+
+bool UAURDriverOpenCV::IsOutputStreamActive() const
+{
+	return GetOutputSink().IsValid();
+}
+
+TSharedPtr<FAURVideoOutputSink, ESPMode::ThreadSafe> UAURDriverOpenCV::GetOutputSink() const
+{
+	FScopeLock lock(&OutputSinkLock);
+	return OutputSink;
+}
+
+bool UAURDriverOpenCV::AddFrameProcessor(FAURFrameProcessorRef const& Processor)
+{
+	return FrameProcessors.AddProcessor(Processor);
+}
+
+void UAURDriverOpenCV::RemoveFrameProcessor(FName const& ProcessorName)
+{
+	FrameProcessors.RemoveProcessor(ProcessorName);
+}
+
+void UAURDriverOpenCV::AddPoseListener(FAURPoseListenerRef const& Listener)
+{
+	Tracker.AddPoseListener(Listener);
+}
+
+void UAURDriverOpenCV::RemovePoseListener(FAURPoseListenerRef const& Listener)
+{
+	Tracker.RemovePoseListener(Listener);
+}
+
+bool UAURDriverOpenCV::GetLastLateUpdateLatch(FAURLateUpdateLatch& OutLatch) const
+{
+	return LateUpdateExtension.IsValid() && LateUpdateExtension->GetLastLatch(OutLatch);
+}
+
+TArray<FAURFrameProcessorTiming> UAURDriverOpenCV::GetFrameProcessorTimings() const
+{
+	return FrameProcessors.GetTimings();
+}
+
+int32 UAURDriverOpenCV::GetDetectionInterval() const
+{
+	return DetectionInterval.GetValue();
+}
+
+void UAURDriverOpenCV::TrackFrame(cv::Mat_<cv::Vec3b> const& frame, cv::Mat_<uint8> const* frame_grey)
+{
+	const double time_now = GetPipelineTime();
+
+	// Scheduling depends on measured durations, so the synchronous mode detects on every frame
+	if (bSynchronousMode
+		|| DetectionScheduler.ShouldDetect(time_now, Tracker.GetMaxPoseSpeed(), Tracker.GetMaxRotationSpeed(), Tracker.GetLastBoardLossTime()))
+	{
+		const double detection_start_time = FPlatformTime::Seconds();
+
+		Tracker.SetNextFrameTime(time_now);
+		if (frame_grey)
+		{
+			Tracker.DetectMarkers(frame, *frame_grey);
+		}
+		else
+		{
+			Tracker.DetectMarkers(frame);
+		}
+
+		if (!bSynchronousMode)
+		{
+			DetectionScheduler.OnDetection(FPlatformTime::Seconds() - detection_start_time);
+			DetectionInterval.Set(DetectionScheduler.GetDetectionInterval());
+		}
+	}
+	else
+	{
+		Tracker.PredictPoses(time_now);
+		DetectionScheduler.OnFrameSkipped();
 	}
 }
 
@@ -85,15 +283,22 @@ void UAURDriverOpenCV::OnVideoSourceSwitch()
 
 void UAURDriverOpenCV::OnCalibrationFinished()
 {
-	if (VideoSource)
+	// A failed calibration does not overwrite the saved one
+	const bool success = !CalibrationProcess.HasFailed();
+
+	if (success && VideoSource)
 	{
 		VideoSource->SaveCalibration(CalibrationProcess.GetCameraProperties());
 	}
 
 	this->bCalibrationInProgress = false;
+	Tracker.SetUseCameraModelForCorners(true);
 
 	// Notify about the change
-	this->OnCameraPropertiesChange();
+	if (success)
+	{
+		this->OnCameraPropertiesChange();
+	}
 
 	// Notify about calibration end
 	this->NotifyCalibrationStatusChange();
@@ -107,6 +312,7 @@ void UAURDriverOpenCV::OnCameraPropertiesChange(FIntPoint resolution_override)
 
 		// Give the camera matrix to the tracker
 		this->Tracker.SetCameraProperties(VideoSource->GetCameraProperties());
+		this->DisplayUndistortion.SetCameraProperties(VideoSource->GetCameraProperties());
 
 		// Allocate proper frame sizes
 		if (resolution_override.X <= 0 || resolution_override.Y <= 0)
@@ -128,6 +334,16 @@ FRunnable * UAURDriverOpenCV::CreateWorker()
 	return new FWorkerRunnable(this);
 }
 
+bool UAURDriverOpenCV::UsesWorkerThread() const
+{
+	return !bSynchronousMode;
+}
+
+double UAURDriverOpenCV::GetPipelineTime() const
+{
+	return bSynchronousMode ? SynchronousFrameNumber * double(SynchronousFrameTime) : FPlatformTime::Seconds();
+}
+
 FVector2D UAURDriverOpenCV::GetFieldOfView() const
 {
 	if (VideoSource)
@@ -174,6 +390,11 @@ float UAURDriverOpenCV::GetCalibrationProgress() const
 	return CalibrationProcess.GetProgress();
 }
 
+float UAURDriverOpenCV::GetCalibrationError() const
+{
+	return CalibrationProcess.GetCalibrationError();
+}
+
 void UAURDriverOpenCV::StartCalibration()
 {
 	FScopeLock lock(&CalibrationLock);
@@ -181,6 +402,9 @@ void UAURDriverOpenCV::StartCalibration()
 	CalibrationProcess.Reset();
 	bCalibrationInProgress = true;
 
+	// The current camera model is what is being replaced
+	Tracker.SetUseCameraModelForCorners(false);
+
 	NotifyCalibrationStatusChange();
 }
 
@@ -190,6 +414,7 @@ void UAURDriverOpenCV::CancelCalibration()
 
 	CalibrationProcess.Reset();
 	bCalibrationInProgress = false;
+	Tracker.SetUseCameraModelForCorners(true);
 
 	NotifyCalibrationStatusChange();
 }
@@ -203,15 +428,57 @@ void UAURDriverOpenCV::SetDiagnosticInfoLevel(EAURDiagnosticInfoLevel NewLevel)
 
 FString UAURDriverOpenCV::GetDiagnosticText() const
 {
+	FScopeLock lock(&DiagnosticTextLock);
 	return this->DiagnosticText;
 }
 
+void UAURDriverOpenCV::UpdateVideoConfigurationStatus()
+{
+	FString status;
+	if (!ConfigurationSelector.GetStatusTextIfChanged(FPlatformTime::Seconds(), STATUS_TEXT_INTERVAL, status))
+	{
+		return;
+	}
+
+	FScopeLock lock(&DiagnosticTextLock);
+	DiagnosticText = TEXT("Video: ") + status;
+}
+
 UAURDriverOpenCV::FWorkerRunnable::FWorkerRunnable(UAURDriverOpenCV * driver)
 	: Driver(driver)
+	, CurrentVideoSource(nullptr)
+{
+	// The buffers are allocated by the video source at the resolution of the first frame
+}
+
+void UAURDriverOpenCV::FWorkerRunnable::SelectCaptureBuffers(FIntPoint const& resolution)
 {
-	//CapturedFrame = cv::Mat(1920, 1080, CV_8UC3, cv::Scalar(0, 0, 255));
-	CapturedFrame.create(1920, 1080);
-	CapturedFrame.setTo(cv::Scalar(0, 0, 255));
+	// Keep the buffers of the previous resolution for a later switch back
+	if (!CapturedFrame.empty())
+	{
+		const FIntPoint previous_resolution(CapturedFrame.cols, CapturedFrame.rows);
+		CaptureBufferCache.RemoveAll([&](FCaptureBuffers const& buffers) { return buffers.Resolution == previous_resolution; });
+		CaptureBufferCache.Add({ previous_resolution, CapturedFrame, CapturedFrameGrey });
+
+		if (CaptureBufferCache.Num() > MAX_CACHED_CAPTURE_BUFFERS)
+		{
+			CaptureBufferCache.RemoveAt(0);
+		}
+	}
+
+	const int32 cached_idx = CaptureBufferCache.IndexOfByPredicate([&](FCaptureBuffers const& buffers) { return buffers.Resolution == resolution; });
+	if (cached_idx != INDEX_NONE)
+	{
+		// cv::Mat assignment shares the data, the cache entry is removed so that only one header refers to it
+		CapturedFrame = CaptureBufferCache[cached_idx].Frame;
+		CapturedFrameGrey = CaptureBufferCache[cached_idx].FrameGrey;
+		CaptureBufferCache.RemoveAt(cached_idx);
+	}
+	else
+	{
+		CapturedFrame.release();
+		CapturedFrameGrey.release();
+	}
 }
 
 bool UAURDriverOpenCV::FWorkerRunnable::Init()
@@ -225,139 +492,275 @@ uint32 UAURDriverOpenCV::FWorkerRunnable::Run()
 {
 	UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCV: Worker thread start"))
 
-	UAURVideoSource* current_video_source = nullptr;
-
 	while (this->bContinue)
 	{
-		// whether we switch to a new vid src in this iteration
-		bool new_video_source_now = false;
-		FAURVideoConfiguration video_config_to_open;
+		if (!Step())
+		{
+			// No video source, wait for a change
+			FPlatformProcess::Sleep(0.25);
+		}
+	}
+
+	Finish();
+
+	// Exiting the loop means the program ends, so release camera
+	UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCV: Worker thread ends"))
+
+	return 0;
+}
+
+bool UAURDriverOpenCV::FWorkerRunnable::Step()
+{
+	// whether we switch to a new vid src in this iteration
+	bool new_video_source_now = false;
+	FAURVideoConfiguration video_config_to_open;
+
+	// Switch video source
+	{
+		FScopeLock lock(&Driver->VideoSourceLock);
 
-		// Switch video source
+		if (Driver->SwitchToNextVideoSource)
 		{
-			FScopeLock lock(&Driver->VideoSourceLock);
+			// Disconnect from previous video source
+			if (CurrentVideoSource)
+			{
+				CurrentVideoSource->Disconnect();
+			}
 
-			if (Driver->SwitchToNextVideoSource)
+			video_config_to_open = Driver->NextVideoConfiguration; //save in local var in case it is modified before we connect to video source
+
+			// The user has chosen a new configuration - the selector may want to measure the alternatives first.
+			// Measurements depend on timing, so they are not done in the synchronous mode.
+			if (!Driver->bNextVideoConfigurationAutomatic && !Driver->bSynchronousMode)
 			{
-				// Disconnect from previous video source
-				if (current_video_source)
+				FAURVideoConfiguration first_probe;
+				if (Driver->ConfigurationSelector.Begin(video_config_to_open, first_probe))
 				{
-					current_video_source->Disconnect();
+					video_config_to_open = first_probe;
 				}
+			}
+			Driver->bNextVideoConfigurationAutomatic = false;
 
-				video_config_to_open = Driver->NextVideoConfiguration; //save in local var in case it is modified before we connect to video source
-				UAURVideoSource* next_src_obj = video_config_to_open.VideoSourceObject;
+			UAURVideoSource* next_src_obj = video_config_to_open.VideoSourceObject;
 
-				const FString vid_src_name = next_src_obj ? next_src_obj->GetIdentifier() : "NULL";
-				UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCV: Switching video source to [%s]"), *vid_src_name);
+			const FString vid_src_name = next_src_obj ? next_src_obj->GetIdentifier() : "NULL";
+			UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCV: Switching video source to [%s]"), *vid_src_name);
 
-				current_video_source = next_src_obj;
-				// need to be kept in UPROPERTY for GC
-				Driver->VideoSource = current_video_source;
+			CurrentVideoSource = next_src_obj;
+			// need to be kept in UPROPERTY for GC
+			Driver->VideoSource = CurrentVideoSource;
 
-				new_video_source_now = true;
-				Driver->SwitchToNextVideoSource = false;
-			}
+			new_video_source_now = true;
+			Driver->SwitchToNextVideoSource = false;
 		}
+	}
 
-		// activate new video source after switch
-		// this is outside the previous block because opening connection can take time
-		// and we don't want to block VideoSourceLock
-		if (new_video_source_now)
+	// activate new video source after switch
+	// this is outside the previous block because opening connection can take time
+	// and we don't want to block VideoSourceLock
+	if (new_video_source_now)
+	{
+		if (CurrentVideoSource)
 		{
-			if (current_video_source)
-			{
-				current_video_source->Connect(video_config_to_open);
-			}
+			CurrentVideoSource->SetRealTimePlayback(!Driver->bSynchronousMode);
+			CurrentVideoSource->Connect(video_config_to_open);
 
-			Driver->OnVideoSourceSwitch();
+			SelectCaptureBuffers(CurrentVideoSource->GetResolution());
 		}
 
-		// If no video source or it is not open, wait for a change
-		if (!current_video_source || !current_video_source->IsConnected())
+		Driver->ConfigurationSelector.OnConfigurationOpened(FPlatformTime::Seconds());
+		Driver->bProbingVideoConfigurations.AtomicSet(Driver->ConfigurationSelector.IsProbing());
+		Driver->UpdateVideoConfigurationStatus();
+
+		Driver->OnVideoSourceSwitch();
+	}
+
+	// Configurations which deliver no frames must also time out
+	{
+		FAURVideoConfiguration next_video_config;
+		if (Driver->ConfigurationSelector.Update(FPlatformTime::Seconds(), next_video_config))
 		{
-			FPlatformProcess::Sleep(0.25);
+			Driver->RequestVideoConfiguration(next_video_config);
+			Driver->UpdateVideoConfigurationStatus();
 		}
-		else
-		{
-			// get a new frame from camera - this blocks untill the next frame is available
-			current_video_source->GetNextFrame(CapturedFrame);
+	}
 
-			// compare the frame size to the size we expect from capture parameters
-			auto frame_size = CapturedFrame.size();
+	// If no video source or it is not open, the caller waits for a change
+	if (!CurrentVideoSource || !CurrentVideoSource->IsConnected())
+	{
+		return false;
+	}
 
-			if (frame_size.width != Driver->FrameResolution.X || frame_size.height != Driver->FrameResolution.Y)
-			{
-				FIntPoint new_camera_res(frame_size.width, frame_size.height);
+	// get a new frame from camera - this blocks untill the next frame is available
+	const double capture_start_time = FPlatformTime::Seconds();
+	CurrentVideoSource->GetNextFrame(CapturedFrame);
+	const double capture_end_time = FPlatformTime::Seconds();
+	// Timestamp of the frame, simulated in the synchronous mode
+	const double frame_time = Driver->GetPipelineTime();
 
-				UE_LOG(LogAUR, Error, TEXT("AURDriverOpenCV: Source returned frame of size %dx%d but %dx%d was expected from source's GetResolution()"),
-					new_camera_res.X, new_camera_res.Y, Driver->FrameResolution.X, Driver->FrameResolution.Y);
+	// compare the frame size to the size we expect from capture parameters
+	auto frame_size = CapturedFrame.size();
 
-				Driver->OnCameraPropertiesChange(new_camera_res);
-			}
-			else
+	if (frame_size.width != Driver->FrameResolution.X || frame_size.height != Driver->FrameResolution.Y)
+	{
+		FIntPoint new_camera_res(frame_size.width, frame_size.height);
+
+		UE_LOG(LogAUR, Error, TEXT("AURDriverOpenCV: Source returned frame of size %dx%d but %dx%d was expected from source's GetResolution()"),
+			new_camera_res.X, new_camera_res.Y, Driver->FrameResolution.X, Driver->FrameResolution.Y);
+
+		Driver->OnCameraPropertiesChange(new_camera_res);
+	}
+	else
+	{
+		FrameOverlay.Reset();
+
+		if (Driver->IsCalibrationInProgress()) // calibration
+		{
+			if (Driver->WorldReference)
 			{
-				if (Driver->IsCalibrationInProgress()) // calibration
+				// The tracker's marker detection also finds the chessboard corners, the frame is not searched twice.
+				// Outside of CalibrationLock, since the pose listeners are called by the detection.
+				// Not through TrackFrame, which may predict poses instead of detecting.
+				const bool use_charuco = Driver->CalibrationPattern == EAURCalibrationPattern::ChArUcoBoard;
+				cv::Ptr<cv::aruco::CharucoBoard> charuco_board;
+				if (use_charuco)
 				{
-					if (Driver->WorldReference)
-					{
-						FScopeLock(&Driver->CalibrationLock);
-						Driver->CalibrationProcess.ProcessFrame(CapturedFrame, Driver->WorldReference->RealTimeSeconds);
+					Driver->Tracker.SetNextFrameTime(Driver->GetPipelineTime());
+					Driver->Tracker.DetectMarkers(CapturedFrame);
 
-						if (Driver->CalibrationProcess.IsFinished())
-						{
-							Driver->OnCalibrationFinished();
-						}
-					}
-					else
+					if (!Driver->Tracker.GetFrameChessboardCorners(CalibrationPoints, CalibrationPointIds, charuco_board))
 					{
-						UE_LOG(LogAUR, Error, TEXT("AURDriverOpenCV: WorldReference is null, cannot measure time for calibration"))
+						CalibrationPoints.clear();
+						CalibrationPointIds.clear();
 					}
 				}
-				else if (this->Driver->bPerformOrientationTracking)
+
+				FScopeLock lock(&Driver->CalibrationLock);
+
+				if (use_charuco)
 				{
-					/**
-					* Tracking markers and relative position with respect to them
-					*/
-					{
-						// lock moved to AURArucoTracker
-						//FScopeLock lock(&Driver->TrackerLock);
-						Driver->Tracker.DetectMarkers(CapturedFrame);
-					}
+					// Returns at once, the calibration is solved on background tasks
+					Driver->CalibrationProcess.ProcessCharucoCorners(CapturedFrame, CalibrationPoints, CalibrationPointIds, charuco_board,
+						Driver->WorldReference->RealTimeSeconds);
+				}
+				else
+				{
+					// Returns at once, the pattern is searched and the calibration solved on background tasks
+					Driver->CalibrationProcess.ProcessFrame(CapturedFrame, Driver->WorldReference->RealTimeSeconds);
 				}
 
-				// ---------------------------
-				// Create the frame to publish
+				// From the last searched frame, which may be a few frames old
+				Driver->CalibrationProcess.GetLastDetectedPoints(CalibrationPoints);
+				for (cv::Point2f const& pt : CalibrationPoints)
+				{
+					FrameOverlay.CalibrationPoints.Add(FVector2D(pt.x / CapturedFrame.cols, pt.y / CapturedFrame.rows));
+				}
 
-				// Frame to fill is in RGBA format
-				FColor* dest_pixel_ptr = Driver->WorkerFrame->Image.GetData();
+				if (Driver->CalibrationProcess.IsFinished())
+				{
+					Driver->OnCalibrationFinished();
+				}
+			}
+			else
+			{
+				UE_LOG(LogAUR, Error, TEXT("AURDriverOpenCV: WorldReference is null, cannot measure time for calibration"))
+			}
+		}
+		else if (Driver->FrameProcessors.HasProcessors())
+		{
+			// Convert once for the tracker and the stages
+			cv::cvtColor(CapturedFrame, CapturedFrameGrey, cv::COLOR_BGR2GRAY);
 
-				for (int32 pixel_r = 0; pixel_r < CapturedFrame.rows; pixel_r++)
+			Driver->FrameProcessors.ProcessFrame(CapturedFrame, CapturedFrameGrey, frame_time, [&]() {
+				if (Driver->bPerformOrientationTracking)
 				{
-					for (int32 pixel_c = 0; pixel_c < CapturedFrame.cols; pixel_c++)
-					{
-						cv::Vec3b& src_pixel = CapturedFrame.at<cv::Vec3b>(pixel_r, pixel_c);
+					Driver->TrackFrame(CapturedFrame, &CapturedFrameGrey);
+				}
+			});
+		}
+		else if (this->Driver->bPerformOrientationTracking)
+		{
+			/**
+			* Tracking markers and relative position with respect to them
+			*/
+			{
+				// lock moved to AURArucoTracker
+				//FScopeLock lock(&Driver->TrackerLock);
+				Driver->TrackFrame(CapturedFrame, nullptr);
+			}
+		}
+
+		if (Driver->bPerformOrientationTracking && !Driver->IsCalibrationInProgress())
+		{
+			Driver->Tracker.GetFrameOverlay(FrameOverlay);
+		}
+
+		// The captured frame is never drawn on, the sink draws the overlay into its own copy
+		TSharedPtr<FAURVideoOutputSink, ESPMode::ThreadSafe> output_sink = Driver->GetOutputSink();
+		if (output_sink.IsValid())
+		{
+			output_sink->PushFrame(CapturedFrame, output_sink->GetSettings().bIncludeDiagnosticOverlay ? &FrameOverlay : nullptr);
+		}
 
-						// Captured image is in BGR format
-						dest_pixel_ptr->R = src_pixel.val[2];
-						dest_pixel_ptr->G = src_pixel.val[1];
-						dest_pixel_ptr->B = src_pixel.val[0];
+		// ---------------------------
+		// Create the frame to publish
 
-						dest_pixel_ptr++;
-					}
-				}
+		// Without consumers only the poses are needed.
+		// If all frames are held by consumers, this one is not published.
+		FAURVideoFrameHandle worker_frame;
+		if (Driver->HasFrameConsumers())
+		{
+			worker_frame = Driver->AcquireWorkerFrame();
+		}
+
+		if (worker_frame.IsValid())
+		{
+			// Frame to fill is in RGBA format, at the display resolution
+			const bool undistorted = Driver->bUndistortDisplay
+				&& Driver->DisplayUndistortion.ConvertBGRToColorUndistorted(CapturedFrame, worker_frame->FrameResolution, worker_frame->Image.GetData());
+
+			if (!undistorted)
+			{
+				FAUROpenCV::ConvertBGRToColorDownscaled(CapturedFrame, worker_frame->FrameResolution, worker_frame->Image.GetData());
+			}
+
+			worker_frame->Overlay = FrameOverlay;
+			if (undistorted)
+			{
+				Driver->DisplayUndistortion.UndistortOverlay(FIntPoint(CapturedFrame.cols, CapturedFrame.rows), worker_frame->Overlay);
+			}
+
+			Driver->StoreWorkerFrame(worker_frame);
+		}
 
-				Driver->StoreWorkerFrame();
+		// Measure the pipeline for the automatic choice of resolution,
+		// calibration is not representative and would be cancelled by a switch
+		if (!Driver->IsCalibrationInProgress() && !Driver->bSynchronousMode)
+		{
+			const double processing_end_time = FPlatformTime::Seconds();
+
+			FAURVideoConfiguration next_video_config;
+			if (Driver->ConfigurationSelector.AddFrameMeasurement(processing_end_time,
+				capture_end_time - capture_start_time, processing_end_time - capture_end_time, next_video_config))
+			{
+				Driver->RequestVideoConfiguration(next_video_config);
 			}
+			Driver->bProbingVideoConfigurations.AtomicSet(Driver->ConfigurationSelector.IsProbing());
+			Driver->UpdateVideoConfigurationStatus();
 		}
 	}
 
+	return true;
+}
+
+void UAURDriverOpenCV::FWorkerRunnable::Finish()
+{
 	// Disconnect video sources and notify the driver about that
 	{
 		FScopeLock lock(&Driver->VideoSourceLock);
-		if (current_video_source && current_video_source->IsConnected())
+		if (CurrentVideoSource && CurrentVideoSource->IsConnected())
 		{
-			current_video_source->Disconnect();
+			CurrentVideoSource->Disconnect();
 		}
 
 		Driver->VideoSource = nullptr;
@@ -365,10 +768,7 @@ uint32 UAURDriverOpenCV::FWorkerRunnable::Run()
 		Driver->OnVideoSourceSwitch();
 	}
 
-	// Exiting the loop means the program ends, so release camera
-	UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCV: Worker thread ends"))
-
-	return 0;
+	CurrentVideoSource = nullptr;
 }
 
 void UAURDriverOpenCV::FWorkerRunnable::Stop()
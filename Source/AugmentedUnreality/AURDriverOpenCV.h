@@ -20,6 +20,12 @@ limitations under the License.
 #include <vector>
 #include "AUROpenCV.h"
 #include "AUROpenCVCalibration.h"
+#include "AURVideoConfigurationSelector.h"
+#include "AURVideoOutputSink.h"
+#include "AURFrameProcessor.h"
+#include "AURDetectionScheduler.h"
+#include "AURDisplayUndistortion.h"
+#include "AURLateUpdate.h"
 #include "tracking/AURArucoTracker.h"
 
 #include "AURDriverOpenCV.generated.h"
@@ -37,10 +43,117 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
 	FArucoTrackerSettings TrackerSettings;
 
+	// Choice of video resolution based on measured capture and detection performance
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FAURVideoAutoConfigurationSettings VideoAutoConfiguration;
+
+	// Encode the camera frames (optionally with detected markers) to a file or network stream
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FAUROutputStreamSettings OutputStream;
+
+	// Skip marker detection on some frames when it exceeds the time budget, poses are predicted in between
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FAURDetectionSchedulingSettings DetectionScheduling;
+
+	/*
+		No worker thread: each Tick captures and processes exactly one frame, with a simulated clock
+		advancing by SynchronousFrameTime per frame. Recorded and generated videos are read without waiting,
+		so two runs over the same recording give the same poses - for benchmarks, profiling and replay.
+		Automatic video configuration and detection scheduling are disabled, live cameras block the game thread.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bSynchronousMode;
+
+	// Simulated time between frames in the synchronous mode (seconds)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.001", UIMin = "0.001"))
+	float SynchronousFrameTime;
+
+	// Remove the lens distortion from the displayed video, so that it matches the geometry used for tracking
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bUndistortDisplay;
+
+	/*
+		Pattern shown to the camera during calibration.
+		For ChArUcoBoard, the corners are taken from the tracker's detection of a registered ChArUco board,
+		the board's poses are published during calibration as usual.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	EAURCalibrationPattern CalibrationPattern;
+
+	/*
+		Move the camera and ActorToMove of boards with bLateUpdateActorToMove to the newest poses just before rendering.
+		On frames where detection is skipped by DetectionScheduling the newest pose is the one predicted from the motion,
+		so late update never returns to an older detected pose.
+		Unlike the properties above, changes are applied on the next Tick.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FAURLateUpdateSettings LateUpdate;
+
 	// Get the currently active video source
 	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	UAURVideoSource* GetVideoSource();
 
+	// True while the configurations of the video source are being measured
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	bool IsProbingVideoConfigurations() const;
+
+	// Start encoding frames according to OutputStream settings, restarts the stream if it is running
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	void StartOutputStream();
+
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	void StopOutputStream();
+
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	bool IsOutputStreamActive() const;
+
+	// Add an extra computation performed on each frame, see IAURFrameProcessor. Can be called from any thread.
+	bool AddFrameProcessor(FAURFrameProcessorRef const& Processor);
+
+	void RemoveFrameProcessor(FName const& ProcessorName);
+
+	/*
+		Receive poses on the detection thread as soon as they are solved, see IAURPoseListener.
+		Can be called from any thread. OnPoseBatchUpdate and the board events still run on the game thread.
+	*/
+	void AddPoseListener(FAURPoseListenerRef const& Listener);
+
+	void RemovePoseListener(FAURPoseListenerRef const& Listener);
+
+	/*
+		Poses at a given time (the clock of FAURVideoFrame::Timestamp), interpolated from the recent measurements,
+		so that for example rendering can use the pose at display time. Can be called from any thread.
+		See FAURArucoTracker::GetBoardPoseAtTime.
+	*/
+	bool GetBoardPoseAtTime(int32 BoardId, double Time, FTransform& OutTransform, bool bFiltered = true) const
+	{
+		return Tracker.GetBoardPoseAtTime(BoardId, Time, OutTransform, bFiltered);
+	}
+
+	bool GetViewpointPoseAtTime(double Time, FTransform& OutTransform, bool bFiltered = true) const
+	{
+		return Tracker.GetViewpointPoseAtTime(Time, OutTransform, bFiltered);
+	}
+
+	/*
+		Poses with which the last frame was rendered, see LateUpdate.
+		Game thread, since the late update is enabled there.
+		Returns false if late update is disabled or no frame was rendered with it yet.
+	*/
+	bool GetLastLateUpdateLatch(FAURLateUpdateLatch& OutLatch) const;
+
+	// Durations of the registered frame processing stages
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	TArray<FAURFrameProcessorTiming> GetFrameProcessorTimings() const;
+
+	// RMS reprojection error (pixels) of the calibration with the frames collected so far, negative before the first estimate
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	float GetCalibrationError() const;
+
+	// Markers are currently detected on every N-th frame, see DetectionScheduling
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	int32 GetDetectionInterval() const;
+
 	//UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	//void SetTrackingBoardDefinition(AAURMarkerBoardDefinitionBase* board_definition);
 
@@ -48,6 +161,7 @@ public:
 
 	virtual void Initialize(AActor* parent_actor) override;
 	virtual void Tick() override;
+	virtual void Shutdown() override;
 
 	virtual void OpenVideoSource(FAURVideoConfiguration const& VideoConfiguration) override;
 	virtual bool RegisterBoard(AAURFiducialPattern* board_actor, bool use_as_viewpoint_origin = false) override;
@@ -78,6 +192,18 @@ protected:
 
 	bool SwitchToNextVideoSource;
 	FAURVideoConfiguration NextVideoConfiguration;
+	// The switch was requested by ConfigurationSelector, not by the user
+	bool bNextVideoConfigurationAutomatic;
+
+	// Frames stepped in the synchronous mode, the simulated clock
+	int64 SynchronousFrameNumber;
+
+	// Used only by the worker thread
+	FAURVideoConfigurationSelector ConfigurationSelector;
+	FThreadSafeBool bProbingVideoConfigurations;
+
+	// Switch configuration on behalf of ConfigurationSelector, called by the worker thread
+	void RequestVideoConfiguration(FAURVideoConfiguration const& VideoConfiguration);
 
 	// Camera calibration
 	FCriticalSection CalibrationLock;
@@ -86,8 +212,38 @@ protected:
 	// Marker tracking
 	FAURArucoTracker Tracker;
 
+	// Extra per-frame stages, run by the worker alongside tracking
+	FAURFrameProcessorGraph FrameProcessors;
+
+	// Remap tables for bUndistortDisplay, used by the worker
+	FAURDisplayUndistortion DisplayUndistortion;
+
+	// Applies LateUpdate on the render thread, exists from when it is first enabled until Shutdown
+	TSharedPtr<FAURLateUpdateViewExtension, ESPMode::ThreadSafe> LateUpdateExtension;
+
+	// Create LateUpdateExtension if needed and give it the current LateUpdate settings, game thread
+	void UpdateLateUpdateSettings();
+
+	// Chooses the frames on which markers are detected, used only by the worker thread
+	FAURDetectionScheduler DetectionScheduler;
+	FThreadSafeCounter DetectionInterval;
+
+	// Detect markers or predict their poses, called by the worker thread
+	void TrackFrame(cv::Mat_<cv::Vec3b> const& frame, cv::Mat_<uint8> const* frame_grey);
+
+	// Output stream, the worker only pushes frames to it
+	mutable FCriticalSection OutputSinkLock;
+	TSharedPtr<FAURVideoOutputSink, ESPMode::ThreadSafe> OutputSink;
+
+	TSharedPtr<FAURVideoOutputSink, ESPMode::ThreadSafe> GetOutputSink() const;
+
+	// Status of the video configuration selector, written by the worker thread
+	mutable FCriticalSection DiagnosticTextLock;
 	FString DiagnosticText;
 
+	// Copy the status of ConfigurationSelector to DiagnosticText when it changed, called by the worker thread
+	void UpdateVideoConfigurationStatus();
+
 	// Called by the worker thread when the new video source is ready
 	void OnVideoSourceSwitch();
 
@@ -97,6 +253,8 @@ protected:
 	void OnCameraPropertiesChange(FIntPoint resolution_override = FIntPoint(0, 0));
 
 	virtual FRunnable* CreateWorker() override;
+	virtual bool UsesWorkerThread() const override;
+	virtual double GetPipelineTime() const override;
 
 	/**
 	 * cv::VideoCapture::read blocks untill a new frame is available.
@@ -116,6 +274,16 @@ protected:
 		virtual void Stop();
 		// End FRunnable interface
 
+		/*
+			One iteration of the pipeline: switch the video source if requested, capture and process one frame.
+			Returns false if there is no connected video source.
+			Called in a loop by Run, or by Tick in the synchronous mode.
+		*/
+		bool Step();
+
+		// Disconnect the video source, after the last Step
+		void Finish();
+
 	protected:
 		// The driver on which we work
 		UAURDriverOpenCV* Driver;
@@ -123,6 +291,30 @@ protected:
 		// Set to false to stop the thread
 		FThreadSafeBool bContinue;
 
+		UAURVideoSource* CurrentVideoSource;
+
 		cv::Mat_<cv::Vec3b> CapturedFrame;
+
+		// Shared by the tracker and the frame processors
+		cv::Mat_<uint8> CapturedFrameGrey;
+
+		// Detections in CapturedFrame, published with the frame
+		FAURFrameOverlay FrameOverlay;
+
+		// Pattern points found by the calibration, kept to reuse the allocation
+		std::vector<cv::Point2f> CalibrationPoints;
+		std::vector<int> CalibrationPointIds;
+
+		struct FCaptureBuffers
+		{
+			FIntPoint Resolution;
+			cv::Mat_<cv::Vec3b> Frame;
+			cv::Mat_<uint8> FrameGrey;
+		};
+		// Buffers of previously used resolutions, most recent last
+		TArray<FCaptureBuffers> CaptureBufferCache;
+
+		// Swap in the buffers of this resolution if it was used before, so switching sources does not allocate
+		void SelectCaptureBuffers(FIntPoint const& resolution);
 	};
 };
@@ -0,0 +1,512 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURDriverOpenCVMultiCamera.h"
+#include "AURLog.h"
+
+UAURDriverOpenCVMultiCamera::UAURDriverOpenCVMultiCamera()
+	: PrimaryCameraIndex(0)
+	, SyncTolerance(0.02)
+	, RigTransform(FTransform::Identity)
+	, bRigTransformKnown(false)
+	, LastFusedCameraCount(0)
+{
+}
+
+void UAURDriverOpenCVMultiCamera::Initialize(AActor* parent_actor)
+{
+	Cameras.Empty();
+	RigVideoSources.Empty();
+	RigBoards.Empty();
+
+	// The cameras have to exist before Super::Initialize, which registers the boards and creates the primary worker
+	for (int32 cam_idx = 0; cam_idx < RigCameras.Num(); cam_idx++)
+	{
+		FAURRigCamera const& rig_cam = RigCameras[cam_idx];
+
+		if (!rig_cam.VideoSourceClass)
+		{
+			UE_LOG(LogAUR, Error, TEXT("UAURDriverOpenCVMultiCamera::Initialize: Null video source class for camera %d"), cam_idx)
+			continue;
+		}
+
+		UAURVideoSource* vid_src = NewObject<UAURVideoSource>(this, rig_cam.VideoSourceClass);
+		vid_src->DiscoverConfigurations();
+		RigVideoSources.Add(vid_src);
+
+		FAURVideoConfiguration const* chosen_cfg = nullptr;
+		for (auto const& cfg : vid_src->Configurations)
+		{
+			if (rig_cam.ConfigurationName.IsEmpty() ? (!chosen_cfg || cfg.Priority > chosen_cfg->Priority) : cfg.Identifier == rig_cam.ConfigurationName)
+			{
+				chosen_cfg = &cfg;
+			}
+		}
+
+		if (!chosen_cfg)
+		{
+			UE_LOG(LogAUR, Error, TEXT("UAURDriverOpenCVMultiCamera::Initialize: No configuration '%s' in %s for camera %d"),
+				*rig_cam.ConfigurationName, *vid_src->GetIdentifier(), cam_idx)
+			continue;
+		}
+
+		FRigCameraInstance* camera = new FRigCameraInstance();
+		camera->Index = cam_idx;
+		camera->VideoSource = vid_src;
+		camera->Configuration = *chosen_cfg;
+		camera->CameraToRig = rig_cam.CameraToRig;
+		camera->Tracker.SetSettings(TrackerSettings);
+		camera->Tracker.SetBoardVisibility(DiagnosticLevel >= EAURDiagnosticInfoLevel::AURD_Basic);
+		Cameras.Emplace(camera);
+	}
+
+	if (!GetPrimaryCamera())
+	{
+		UE_LOG(LogAUR, Error, TEXT("UAURDriverOpenCVMultiCamera::Initialize: PrimaryCameraIndex %d does not refer to a working camera"), PrimaryCameraIndex)
+	}
+
+	Super::Initialize(parent_actor);
+
+	for (auto& camera : Cameras)
+	{
+		if (camera.Get() != GetPrimaryCamera())
+		{
+			camera->Worker.Reset(new FCameraWorkerRunnable(this, camera.Get()));
+			FString thread_name = FString::Printf(TEXT("%s_CameraCaptureThread_%d"), *GetName(), camera->Index);
+			camera->WorkerThread.Reset(FAURThreading::CreateWorkerThread(camera->Worker.Get(), thread_name, Threading));
+		}
+	}
+}
+
+void UAURDriverOpenCVMultiCamera::Shutdown()
+{
+	for (auto& camera : Cameras)
+	{
+		if (camera->Worker.IsValid())
+		{
+			camera->Worker->Stop();
+
+			if (camera->WorkerThread.IsValid())
+			{
+				camera->WorkerThread->WaitForCompletion();
+			}
+
+			camera->WorkerThread.Reset(nullptr);
+			camera->Worker.Reset(nullptr);
+		}
+	}
+
+	// Stops the primary worker
+	Super::Shutdown();
+}
+
+FRunnable* UAURDriverOpenCVMultiCamera::CreateWorker()
+{
+	FRigCameraInstance* primary = GetPrimaryCamera();
+	return primary ? new FCameraWorkerRunnable(this, primary) : nullptr;
+}
+
+UAURDriverOpenCVMultiCamera::FRigCameraInstance* UAURDriverOpenCVMultiCamera::GetPrimaryCamera() const
+{
+	for (auto const& camera : Cameras)
+	{
+		if (camera->Index == PrimaryCameraIndex)
+		{
+			return camera.Get();
+		}
+	}
+	return nullptr;
+}
+
+void UAURDriverOpenCVMultiCamera::Tick()
+{
+	Super::Tick();
+
+	if (bActive)
+	{
+		PoseBatch.Reset();
+
+		for (auto& camera : Cameras)
+		{
+			camera->Tracker.SendBoardActorTransforms();
+		}
+
+		FuseMeasurements();
+
+		BroadcastPoseBatch();
+	}
+}
+
+void UAURDriverOpenCVMultiCamera::FuseMeasurements()
+{
+	TArray<FTimedTransform> viewpoint_measurements;
+	TMap<int32, TArray<FTimedTransform>> board_measurements;
+
+	for (auto& camera : Cameras)
+	{
+		FScopeLock lock(&camera->MeasurementLock);
+
+		if (camera->MeasurementSequence == camera->FusedSequence)
+		{
+			continue;
+		}
+		camera->FusedSequence = camera->MeasurementSequence;
+
+		if (camera->bCameraTransformMeasured)
+		{
+			// Pose of the rig implied by this camera: camera -> rig -> world
+			viewpoint_measurements.Add({
+				camera->MeasurementTime,
+				camera->CameraToRig.Inverse() * camera->MeasuredCameraTransform,
+				1.0f
+			});
+		}
+
+		for (FAURArucoTracker::FFrameBoardMeasurement const& board : camera->MeasuredBoards)
+		{
+			// Pose of the board in the rig: board -> camera -> rig
+			board_measurements.FindOrAdd(board.BoardId).Add({
+				camera->MeasurementTime,
+				board.Transform * camera->CameraToRig,
+				board.Quality
+			});
+		}
+	}
+
+	if (FuseViewpointMeasurements(viewpoint_measurements))
+	{
+		OnViewpointTransformUpdate.Broadcast(this, RigTransform);
+	}
+
+	FuseBoardMeasurements(board_measurements);
+}
+
+int32 UAURDriverOpenCVMultiCamera::FuseTransforms(TArray<FTimedTransform> const& measurements, FTransform& out_transform,
+	double& out_time, float& out_quality) const
+{
+	double newest_time = -1.0;
+	for (auto const& measurement : measurements)
+	{
+		newest_time = FMath::Max(newest_time, measurement.Time);
+	}
+
+	FVector translation_sum(0, 0, 0);
+	FQuat rotation_sum(0, 0, 0, 0);
+	FQuat reference_rotation = FQuat::Identity;
+	int32 fused_count = 0;
+	out_quality = 0;
+
+	for (auto const& measurement : measurements)
+	{
+		if (newest_time - measurement.Time > SyncTolerance)
+		{
+			continue;
+		}
+
+		FQuat rotation = measurement.Transform.GetRotation();
+		if (fused_count == 0)
+		{
+			reference_rotation = rotation;
+		}
+		// q and -q are the same rotation, keep them on one hemisphere so they do not cancel out
+		else if ((reference_rotation | rotation) < 0)
+		{
+			rotation *= -1.0f;
+		}
+
+		translation_sum += measurement.Transform.GetTranslation();
+		rotation_sum += rotation;
+		out_quality = FMath::Max(out_quality, measurement.Quality);
+		fused_count++;
+	}
+
+	if (fused_count > 0)
+	{
+		rotation_sum.Normalize();
+		out_transform = FTransform(rotation_sum, translation_sum / fused_count);
+		out_time = newest_time;
+	}
+
+	return fused_count;
+}
+
+bool UAURDriverOpenCVMultiCamera::FuseViewpointMeasurements(TArray<FTimedTransform> const& measurements)
+{
+	FTransform fused_transform;
+	double fused_time;
+	float fused_quality;
+	const int32 fused_count = FuseTransforms(measurements, fused_transform, fused_time, fused_quality);
+
+	if (fused_count == 0)
+	{
+		return false;
+	}
+
+	if (bRigTransformKnown)
+	{
+		RigTransform.BlendWith(fused_transform, 1.0 - TrackerSettings.SmoothingStrength);
+	}
+	else
+	{
+		RigTransform = fused_transform;
+		bRigTransformKnown = true;
+	}
+
+	LastFusedCameraCount = fused_count;
+	return true;
+}
+
+void UAURDriverOpenCVMultiCamera::FuseBoardMeasurements(TMap<int32, TArray<FTimedTransform>> const& measurements)
+{
+	for (auto const& board_measurements : measurements)
+	{
+		// Measurements made before the board was unregistered
+		FRigBoard* board = RigBoards.Find(board_measurements.Key);
+		if (!board || !board->BoardActor)
+		{
+			continue;
+		}
+
+		FTransform fused_transform;
+		double fused_time;
+		float fused_quality;
+		if (FuseTransforms(board_measurements.Value, fused_transform, fused_time, fused_quality) == 0)
+		{
+			continue;
+		}
+
+		if (board->bMeasured)
+		{
+			board->BoardToRig.BlendWith(fused_transform, 1.0 - TrackerSettings.SmoothingStrength);
+		}
+		else
+		{
+			board->BoardToRig = fused_transform;
+			board->bMeasured = true;
+		}
+
+		// Same as FAURArucoTracker::PublishTransformUpdate, but once for all cameras
+		const FTransform board_transform = board->BoardToRig * RigTransform;
+
+		// Skip poses which did not change noticeably, unless the board was never published
+		if (board->bPublished
+			&& FVector::Dist(board_transform.GetLocation(), board->PublishedTransform.GetLocation()) < TrackerSettings.PublishMinTranslation
+			&& FMath::RadiansToDegrees(board_transform.GetRotation().AngularDistance(board->PublishedTransform.GetRotation())) < TrackerSettings.PublishMinRotation)
+		{
+			continue;
+		}
+
+		board->PublishedTransform = board_transform;
+		board->bPublished = true;
+
+		board->BoardActor->TransformMeasured(board_transform);
+		PoseBatch.Add(board_measurements.Key, board->BoardActor, board_transform, fused_quality, fused_time);
+	}
+}
+
+FTransform UAURDriverOpenCVMultiCamera::GetRigTransform() const
+{
+	return RigTransform;
+}
+
+bool UAURDriverOpenCVMultiCamera::RegisterBoard(AAURFiducialPattern* board_actor, bool use_as_viewpoint_origin)
+{
+	// Every camera detects every board, the driver publishes the fused poses
+	bool success = Cameras.Num() > 0;
+	for (auto& camera : Cameras)
+	{
+		success &= camera->Tracker.RegisterBoard(board_actor, use_as_viewpoint_origin);
+	}
+
+	// Viewpoint origins are fused into the rig transform instead
+	if (success && !use_as_viewpoint_origin)
+	{
+		const int32 board_id = board_actor->GetPatternDefinition()->getMinMarkerId();
+		RigBoards.Add(board_id, { board_actor, FTransform::Identity, false, FTransform::Identity, false });
+	}
+	return success;
+}
+
+void UAURDriverOpenCVMultiCamera::UnregisterBoard(AAURFiducialPattern* board_actor)
+{
+	for (auto& camera : Cameras)
+	{
+		camera->Tracker.UnregisterBoard(board_actor);
+	}
+
+	for (auto it = RigBoards.CreateIterator(); it; ++it)
+	{
+		if (it->Value.BoardActor == board_actor)
+		{
+			it.RemoveCurrent();
+		}
+	}
+}
+
+void UAURDriverOpenCVMultiCamera::SetDiagnosticInfoLevel(EAURDiagnosticInfoLevel NewLevel)
+{
+	Super::SetDiagnosticInfoLevel(NewLevel);
+
+	for (auto& camera : Cameras)
+	{
+		camera->Tracker.SetDiagnosticInfoLevel(NewLevel);
+	}
+}
+
+FVector2D UAURDriverOpenCVMultiCamera::GetFieldOfView() const
+{
+	FRigCameraInstance* primary = GetPrimaryCamera();
+	if (primary)
+	{
+		return primary->VideoSource->GetCameraProperties().FOV;
+	}
+	else
+	{
+		return FIntPoint(1, 1);
+	}
+}
+
+FTransform UAURDriverOpenCVMultiCamera::GetCurrentViewportTransform() const
+{
+	return RigTransform;
+}
+
+bool UAURDriverOpenCVMultiCamera::IsConnected() const
+{
+	FRigCameraInstance* primary = GetPrimaryCamera();
+	return primary && primary->VideoSource->IsConnected();
+}
+
+void UAURDriverOpenCVMultiCamera::OnPrimaryCameraPropertiesChange(FIntPoint resolution)
+{
+	UE_LOG(LogAUR, Log, TEXT("UAURDriverOpenCVMultiCamera: Primary camera resolution %dx%d"), resolution.X, resolution.Y)
+
+	bNewFrameReady.AtomicSet(false);
+	SetFrameResolution(resolution);
+	NotifyVideoPropertiesChange();
+}
+
+UAURDriverOpenCVMultiCamera::FCameraWorkerRunnable::FCameraWorkerRunnable(UAURDriverOpenCVMultiCamera* driver, FRigCameraInstance* camera)
+	: Driver(driver)
+	, Camera(camera)
+{
+}
+
+bool UAURDriverOpenCVMultiCamera::FCameraWorkerRunnable::Init()
+{
+	this->bContinue = true;
+	UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCVMultiCamera: Worker init for camera %d"), Camera->Index)
+	return true;
+}
+
+uint32 UAURDriverOpenCVMultiCamera::FCameraWorkerRunnable::Run()
+{
+	UAURVideoSource* video_source = Camera->VideoSource;
+	const bool is_primary = Camera == Driver->GetPrimaryCamera();
+
+	UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCVMultiCamera: Camera %d connecting to [%s]"), Camera->Index, *Camera->Configuration.Identifier)
+
+	if (video_source->Connect(Camera->Configuration))
+	{
+		video_source->GetCameraProperties().PrintToLog();
+		Camera->Tracker.SetCameraProperties(video_source->GetCameraProperties());
+
+		if (is_primary)
+		{
+			Driver->OnPrimaryCameraPropertiesChange(video_source->GetResolution());
+		}
+	}
+	else
+	{
+		UE_LOG(LogAUR, Error, TEXT("AURDriverOpenCVMultiCamera: Camera %d failed to connect"), Camera->Index)
+	}
+
+	while (this->bContinue)
+	{
+		if (!video_source->IsConnected())
+		{
+			FPlatformProcess::Sleep(0.25);
+			continue;
+		}
+
+		// this blocks untill the next frame is available
+		video_source->GetNextFrame(CapturedFrame);
+
+		// The frames of different cameras are matched by the time of arrival,
+		// UAURVideoSource does not provide the capture time
+		const double frame_time = FPlatformTime::Seconds();
+
+		if (Driver->bPerformOrientationTracking)
+		{
+			Camera->Tracker.SetNextFrameTime(frame_time);
+			Camera->Tracker.DetectMarkers(CapturedFrame);
+
+			FTransform camera_transform;
+			const bool camera_measured = Camera->Tracker.GetFrameViewpointMeasurement(camera_transform);
+			Camera->Tracker.GetFrameBoardMeasurements(FrameBoards);
+
+			if (camera_measured || FrameBoards.Num() > 0)
+			{
+				FScopeLock lock(&Camera->MeasurementLock);
+				Camera->MeasurementTime = frame_time;
+				Camera->bCameraTransformMeasured = camera_measured;
+				Camera->MeasuredCameraTransform = camera_transform;
+				Swap(Camera->MeasuredBoards, FrameBoards);
+				Camera->MeasurementSequence++;
+			}
+		}
+
+		if (is_primary && Driver->HasFrameConsumers())
+		{
+			auto frame_size = CapturedFrame.size();
+
+			if (frame_size.width != Driver->FrameResolution.X || frame_size.height != Driver->FrameResolution.Y)
+			{
+				UE_LOG(LogAUR, Error, TEXT("AURDriverOpenCVMultiCamera: Source returned frame of size %dx%d but %dx%d was expected from source's GetResolution()"),
+					frame_size.width, frame_size.height, Driver->FrameResolution.X, Driver->FrameResolution.Y);
+
+				Driver->OnPrimaryCameraPropertiesChange(FIntPoint(frame_size.width, frame_size.height));
+			}
+			else
+			{
+				FAURVideoFrameHandle worker_frame = Driver->AcquireWorkerFrame();
+				if (worker_frame.IsValid())
+				{
+					FAUROpenCV::ConvertBGRToColorDownscaled(CapturedFrame, worker_frame->FrameResolution, worker_frame->Image.GetData());
+
+					worker_frame->Overlay.Reset();
+					Camera->Tracker.GetFrameOverlay(worker_frame->Overlay);
+
+					Driver->StoreWorkerFrame(worker_frame);
+				}
+			}
+		}
+	}
+
+	if (video_source->IsConnected())
+	{
+		video_source->Disconnect();
+	}
+
+	UE_LOG(LogAUR, Log, TEXT("AURDriverOpenCVMultiCamera: Worker thread for camera %d ends"), Camera->Index)
+
+	return 0;
+}
+
+void UAURDriverOpenCVMultiCamera::FCameraWorkerRunnable::Stop()
+{
+	this->bContinue = false;
+}
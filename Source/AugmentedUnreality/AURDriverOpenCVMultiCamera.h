@@ -0,0 +1,221 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "AURDriverThreaded.h"
+#include "AUROpenCV.h"
+#include "tracking/AURArucoTracker.h"
+
+#include "AURDriverOpenCVMultiCamera.generated.h"
+
+/**
+ * One camera of a rig.
+ */
+USTRUCT(BlueprintType)
+struct FAURRigCamera
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	TSubclassOf<UAURVideoSource> VideoSourceClass;
+
+	// Identifier of the configuration to open, if empty the configuration with highest priority is used
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FString ConfigurationName;
+
+	/*
+		Pose of this camera in the rig's coordinate frame (camera looking along X, like UE cameras).
+		The rig frame is usually the frame of the primary camera, so that camera has identity here.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FTransform CameraToRig;
+
+	FAURRigCamera()
+		: CameraToRig(FTransform::Identity)
+	{
+	}
+};
+
+/**
+ * Runs several cameras looking at the same markers.
+ * Each camera has its own capture and detection thread. The measurements of the cameras are matched by
+ * the time the frames arrived (the video sources do not provide capture timestamps):
+ * the viewpoints are fused into one rig pose, and each board seen by several cameras into one board pose.
+ * The video of the primary camera is published as the driver's frames.
+ */
+UCLASS(Blueprintable, BlueprintType)
+class UAURDriverOpenCVMultiCamera : public UAURDriverThreaded
+{
+	GENERATED_BODY()
+
+public:
+	// ONLY SET THESE PROPERTIES BEFORE CALLING Initialize()
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FArucoTrackerSettings TrackerSettings;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	TArray<FAURRigCamera> RigCameras;
+
+	// Index in RigCameras of the camera whose video is displayed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	int32 PrimaryCameraIndex;
+
+	// Measurements from different cameras are fused only if their frames arrived less than this apart (seconds)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float SyncTolerance;
+
+	// Pose of the rig fused from all cameras
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	FTransform GetRigTransform() const;
+
+	// Number of cameras which contributed to the last fused pose
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	int32 GetLastFusedCameraCount() const
+	{
+		return LastFusedCameraCount;
+	}
+
+	UAURDriverOpenCVMultiCamera();
+
+	virtual void Initialize(AActor* parent_actor) override;
+	virtual void Tick() override;
+	virtual void Shutdown() override;
+
+	virtual bool RegisterBoard(AAURFiducialPattern* board_actor, bool use_as_viewpoint_origin = false) override;
+	virtual void UnregisterBoard(AAURFiducialPattern* board_actor) override;
+
+	virtual FVector2D GetFieldOfView() const override;
+	virtual FTransform GetCurrentViewportTransform() const override;
+	virtual bool IsConnected() const override;
+
+	virtual void SetDiagnosticInfoLevel(EAURDiagnosticInfoLevel NewLevel) override;
+
+protected:
+	// Keeps the video sources referenced for GC
+	UPROPERTY(Transient)
+	TArray<UAURVideoSource*> RigVideoSources;
+
+	struct FRigCameraInstance
+	{
+		int32 Index;
+		UAURVideoSource* VideoSource;
+		FAURVideoConfiguration Configuration;
+		FTransform CameraToRig;
+
+		FAURArucoTracker Tracker;
+
+		// Measurements of the last frame in which anything was detected, written by the camera's worker
+		FCriticalSection MeasurementLock;
+		uint32 MeasurementSequence;
+		double MeasurementTime;
+		bool bCameraTransformMeasured;
+		FTransform MeasuredCameraTransform;
+		TArray<FAURArucoTracker::FFrameBoardMeasurement> MeasuredBoards;
+
+		// Sequence number of the measurement already used for fusion, game thread only
+		uint32 FusedSequence;
+
+		TUniquePtr<FRunnable> Worker;
+		TUniquePtr<FRunnableThread> WorkerThread;
+
+		FRigCameraInstance()
+			: Index(0)
+			, VideoSource(nullptr)
+			, CameraToRig(FTransform::Identity)
+			, MeasurementSequence(0)
+			, MeasurementTime(0)
+			, bCameraTransformMeasured(false)
+			, MeasuredCameraTransform(FTransform::Identity)
+			, FusedSequence(0)
+		{
+		}
+	};
+
+	TArray<TUniquePtr<FRigCameraInstance>> Cameras;
+
+	FTransform RigTransform;
+	bool bRigTransformKnown;
+	int32 LastFusedCameraCount;
+
+	// Boards registered with the driver, shared by all cameras, game thread only
+	struct FRigBoard
+	{
+		AAURFiducialPattern* BoardActor;
+		// Smoothed pose in the rig's frame
+		FTransform BoardToRig;
+		bool bMeasured;
+		// Last transform published to the actor, poses close to it are skipped
+		FTransform PublishedTransform;
+		bool bPublished;
+	};
+	TMap<int32, FRigBoard> RigBoards;
+
+	// Measurement of a camera converted to the rig's frame
+	struct FTimedTransform
+	{
+		double Time;
+		FTransform Transform;
+		float Quality;
+	};
+
+	FRigCameraInstance* GetPrimaryCamera() const;
+
+	/*
+		Average the measurements taken at about the same time as the newest one, older ones are dropped
+		so that a lagging camera does not pull the pose back. Returns the number of measurements used.
+	*/
+	int32 FuseTransforms(TArray<FTimedTransform> const& measurements, FTransform& out_transform, double& out_time, float& out_quality) const;
+
+	// Match the newest measurements of the cameras and combine them into RigTransform and the boards' poses
+	void FuseMeasurements();
+
+	// Combine the new measurements of the viewpoint into RigTransform, returns true if updated
+	bool FuseViewpointMeasurements(TArray<FTimedTransform> const& measurements);
+
+	// Combine the new measurements of each board and publish it once
+	void FuseBoardMeasurements(TMap<int32, TArray<FTimedTransform>> const& measurements);
+
+	// Called by the primary camera's worker
+	void OnPrimaryCameraPropertiesChange(FIntPoint resolution);
+
+	// The primary camera's worker is created by UAURDriverThreaded, the others in Initialize
+	virtual FRunnable* CreateWorker() override;
+
+	class FCameraWorkerRunnable : public FRunnable
+	{
+	public:
+		FCameraWorkerRunnable(UAURDriverOpenCVMultiCamera* driver, FRigCameraInstance* camera);
+
+		// Begin FRunnable interface.
+		virtual bool Init();
+		virtual uint32 Run();
+		virtual void Stop();
+		// End FRunnable interface
+
+	protected:
+		UAURDriverOpenCVMultiCamera* Driver;
+		FRigCameraInstance* Camera;
+
+		// Set to false to stop the thread
+		FThreadSafeBool bContinue;
+
+		cv::Mat_<cv::Vec3b> CapturedFrame;
+
+		// Board measurements of the current frame, swapped with the camera's to reuse the allocations
+		TArray<FAURArucoTracker::FFrameBoardMeasurement> FrameBoards;
+	};
+};
@@ -16,30 +16,36 @@ limitations under the License.
 
 #include "AURDriverThreaded.h"
 #include "AURLog.h"
-#include <utility> // swap
 #include "Async/Async.h"
 
 UAURDriverThreaded::UAURDriverThreaded()
-	: bNewFrameReady(false)
+	: FramePoolMaxSize(8)
+	, bNewFrameReady(false)
+	, NextSequenceNumber(1)
 {
 }
 
 void UAURDriverThreaded::Initialize(AActor* parent_actor)
 {
+	FramePool = MakeShareable(new FAURVideoFramePool(FramePoolMaxSize));
+	FramePool->SetResolution(DisplayResolution);
+
+	FAURThreading::ApplyParallelSettings(Threading);
+
 	Super::Initialize(parent_actor);
 
 	this->bNewFrameReady = false;
 
-	this->WorkerFrame = &this->FrameInstances[0];
-	this->AvailableFrame = &this->FrameInstances[1];
-	this->PublishedFrame = &this->FrameInstances[2];
-
 	FRunnable* to_run = CreateWorker();
 	if (to_run)
 	{
 		this->Worker.Reset(to_run);
-		FString thread_name = this->GetName() + "_CameraCaptureThread";
-		this->WorkerThread.Reset(FRunnableThread::Create(to_run, *thread_name, 0, TPri_Normal));
+
+		if (UsesWorkerThread())
+		{
+			FString thread_name = this->GetName() + "_CameraCaptureThread";
+			this->WorkerThread.Reset(FAURThreading::CreateWorkerThread(to_run, thread_name, Threading));
+		}
 	}
 }
 
@@ -59,6 +65,16 @@ void UAURDriverThreaded::Shutdown()
 		this->Worker.Reset(nullptr);
 	}
 
+	{
+		FScopeLock lock(&this->FrameLock);
+		LatestFrame.Reset();
+		PublishedFrame.Reset();
+		bNewFrameReady.AtomicSet(false);
+	}
+
+	// Frames still held by consumers are deleted when they release them
+	FramePool.Reset();
+
 	Super::Shutdown();
 }
 
@@ -75,20 +91,29 @@ FIntPoint UAURDriverThreaded::GetResolution() const
 
 FAURVideoFrame* UAURDriverThreaded::GetFrame()
 {
+	WarnIfNoFrameConsumers(TEXT("GetFrame"));
+
 	// If there is a new frame produced
 	if(this->bNewFrameReady)
 	{
-		// Manipulating frame pointers
 		FScopeLock lock(&this->FrameLock);
 
-		// Put the new ready frame in PublishedFrame
-		std::swap(this->AvailableFrame, this->PublishedFrame);
+		// Keep our reference so the pointer stays valid until the next call
+		PublishedFrame = LatestFrame;
 
 		this->bNewFrameReady.AtomicSet(false);
 	}
 	// if there is no new frame, return the old one again
 
-	return this->PublishedFrame;
+	return PublishedFrame.Get();
+}
+
+FAURVideoFrameHandle UAURDriverThreaded::GetFrameHandle()
+{
+	WarnIfNoFrameConsumers(TEXT("GetFrameHandle"));
+
+	FScopeLock lock(&this->FrameLock);
+	return LatestFrame;
 }
 
 bool UAURDriverThreaded::IsNewFrameAvailable() const
@@ -96,12 +121,26 @@ bool UAURDriverThreaded::IsNewFrameAvailable() const
 	return this->bNewFrameReady;
 }
 
-void UAURDriverThreaded::StoreWorkerFrame()
+FAURVideoFramePoolStats UAURDriverThreaded::GetFramePoolStats() const
 {
-	FScopeLock(&this->FrameLock);
+	return FramePool.IsValid() ? FramePool->GetStats() : FAURVideoFramePoolStats();
+}
+
+FAURVideoFrameHandle UAURDriverThreaded::AcquireWorkerFrame()
+{
+	return FramePool.IsValid() ? FramePool->Acquire() : FAURVideoFrameHandle();
+}
 
-	// Put the generated frame as available frame
-	std::swap(WorkerFrame, AvailableFrame);
+void UAURDriverThreaded::StoreWorkerFrame(FAURVideoFrameHandle const& frame)
+{
+	frame->Timestamp = GetPipelineTime();
+
+	FScopeLock lock(&this->FrameLock);
+
+	frame->SequenceNumber = NextSequenceNumber++;
+
+	// The previous frame returns to the pool once no consumer holds it
+	LatestFrame = frame;
 	bNewFrameReady.AtomicSet(true);
 }
 
@@ -109,10 +148,37 @@ void UAURDriverThreaded::SetFrameResolution(FIntPoint const & new_res)
 {
 	Super::SetFrameResolution(new_res);
 
-	FrameResolution = new_res;
-	for (int idx = 0; idx < 3; idx++)
+	if (FramePool.IsValid())
+	{
+		FramePool->SetResolution(DisplayResolution);
+	}
+
+	// Frames of the old resolution must not reach the new texture
 	{
-		this->FrameInstances[idx].SetResolution(new_res);
+		FScopeLock lock(&this->FrameLock);
+		LatestFrame.Reset();
+		bNewFrameReady.AtomicSet(false);
+	}
+}
+
+void UAURDriverThreaded::OnFrameConsumersChange()
+{
+	Super::OnFrameConsumersChange();
+
+	// Tracking only - the worker stops producing frames, release their memory
+	if (!HasFrameConsumers())
+	{
+		{
+			FScopeLock lock(&this->FrameLock);
+			LatestFrame.Reset();
+			PublishedFrame.Reset();
+			bNewFrameReady.AtomicSet(false);
+		}
+
+		if (FramePool.IsValid())
+		{
+			FramePool->ReleaseFreeFrames();
+		}
 	}
 }
 
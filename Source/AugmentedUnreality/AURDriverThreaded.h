@@ -17,7 +17,8 @@ limitations under the License.
 #pragma once
 
 #include "AURDriver.h"
-#include <vector>
+#include "AURVideoFramePool.h"
+#include "AURThreading.h"
 #include "AURDriverThreaded.generated.h"
 
 /**
@@ -30,6 +31,14 @@ class UAURDriverThreaded : public UAURDriver
 	GENERATED_BODY()
 
 public:
+	// Upper limit of frames held at the same time by the capture thread and all consumers
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "3", UIMin = "3"))
+	int32 FramePoolMaxSize;
+
+	// Priority and cores of the capture threads, use of the engine's task graph
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	FAURThreadingSettings Threading;
+
 	UAURDriverThreaded();
 
 	virtual void Initialize(AActor* parent_actor) override;
@@ -37,18 +46,22 @@ public:
 
 	virtual FIntPoint GetResolution() const override;
 	virtual FAURVideoFrame* GetFrame() override;
+	virtual FAURVideoFrameHandle GetFrameHandle() override;
 	virtual bool IsNewFrameAvailable() const override;
 
+	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
+	FAURVideoFramePoolStats GetFramePoolStats() const;
+
 protected:
 	// Threaded capture model
-	FCriticalSection FrameLock; // mutex which needs to be obtained before manipulating the frame pointers
-	FThreadSafeBool bNewFrameReady; // is there a new frame in AvailableFrame
+	FCriticalSection FrameLock; // mutex which needs to be obtained before manipulating LatestFrame
+	FThreadSafeBool bNewFrameReady; // has LatestFrame changed since the last GetFrame
 
-	FAURVideoFrame* WorkerFrame; // the frame processed by worker thread
-	FAURVideoFrame* AvailableFrame; // the frame ready to be published
-	FAURVideoFrame* PublishedFrame; // the frame currently held by the game
+	FAURVideoFrameHandle LatestFrame; // the newest frame published by the worker
+	FAURVideoFrameHandle PublishedFrame; // the frame returned by GetFrame, held until the next call
+	int64 NextSequenceNumber;
 
-	FAURVideoFrame FrameInstances[3];
+	TSharedPtr<FAURVideoFramePool, ESPMode::ThreadSafe> FramePool;
 
 	//FCriticalSection TrackerLock; // mutex which needs to be obtained before using marker tracker
 	
@@ -58,10 +71,26 @@ protected:
 	// Override this method and create the specific class of FRunnable.
 	virtual FRunnable* CreateWorker();
 
-	// Publish a new frame - switched the publicly available frame with the one held by background thread.
-	virtual void StoreWorkerFrame();
+	// If false, the worker is created but not started on its own thread and the driver has to run it
+	virtual bool UsesWorkerThread() const
+	{
+		return true;
+	}
+
+	// Clock of the capture pipeline, used to timestamp the frames
+	virtual double GetPipelineTime() const
+	{
+		return FPlatformTime::Seconds();
+	}
+
+	// Get a frame of the current resolution for the worker to fill, null if all frames are held by consumers.
+	FAURVideoFrameHandle AcquireWorkerFrame();
+
+	// Publish a frame filled by the worker as the newest frame.
+	virtual void StoreWorkerFrame(FAURVideoFrameHandle const& frame);
 
 	virtual void SetFrameResolution(FIntPoint const& new_res) override;
+	virtual void OnFrameConsumersChange() override;
 
 	// Call the delegates from game thread
 	void NotifyVideoPropertiesChange();
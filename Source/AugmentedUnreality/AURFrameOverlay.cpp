@@ -0,0 +1,122 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURFrameOverlay.h"
+#include "Engine/Canvas.h"
+#include "Engine/Engine.h"
+
+static const float LINE_THICKNESS = 2.0;
+// Half size (canvas pixels) of the marks of single points
+static const float POINT_MARK_SIZE = 4.0;
+
+static const FLinearColor MARKER_COLOR(0.0, 1.0, 0.0);
+static const FLinearColor MARKER_FIRST_CORNER_COLOR(1.0, 0.0, 0.0);
+static const FLinearColor MARKER_ID_COLOR(0.0, 0.0, 1.0);
+static const FLinearColor RESIDUAL_COLOR(1.0, 0.0, 1.0);
+static const FLinearColor CALIBRATION_POINT_COLOR(1.0, 1.0, 0.0);
+
+void FAURFrameOverlay::ForEachPoint(TFunctionRef<void(FVector2D& point)> func)
+{
+	for (FAURMarkerOverlay& marker : Markers)
+	{
+		for (FVector2D& pt : marker.Corners)
+		{
+			func(pt);
+		}
+		for (FVector2D& pt : marker.ReprojectedCorners)
+		{
+			func(pt);
+		}
+	}
+
+	for (FAURBoardOverlay& board : Boards)
+	{
+		func(board.Origin);
+		func(board.AxisX);
+		func(board.AxisY);
+		func(board.AxisZ);
+	}
+
+	for (FVector2D& pt : CalibrationPoints)
+	{
+		func(pt);
+	}
+}
+
+void FAURFrameOverlay::Draw(UCanvas* canvas, FVector2D const& position, FVector2D const& size) const
+{
+	if (!canvas)
+	{
+		return;
+	}
+
+	auto to_canvas = [&](FVector2D const& pt) {
+		return position + pt * size;
+	};
+
+	for (FAURMarkerOverlay const& marker : Markers)
+	{
+		const int32 num_corners = marker.Corners.Num();
+		for (int32 idx = 0; idx < num_corners; idx++)
+		{
+			canvas->K2_DrawLine(to_canvas(marker.Corners[idx]), to_canvas(marker.Corners[(idx + 1) % num_corners]), LINE_THICKNESS, MARKER_COLOR);
+		}
+
+		if (num_corners > 0)
+		{
+			const FVector2D first_corner = to_canvas(marker.Corners[0]);
+			canvas->K2_DrawBox(first_corner - FVector2D(POINT_MARK_SIZE, POINT_MARK_SIZE), FVector2D(2 * POINT_MARK_SIZE, 2 * POINT_MARK_SIZE),
+				LINE_THICKNESS, MARKER_FIRST_CORNER_COLOR);
+
+			FVector2D center(0, 0);
+			for (FVector2D const& pt : marker.Corners)
+			{
+				center += pt;
+			}
+			center = to_canvas(center / num_corners);
+
+			canvas->SetDrawColor(MARKER_ID_COLOR.ToFColor(true));
+			canvas->DrawText(GEngine->GetSmallFont(), FString::Printf(TEXT("id=%d"), marker.MarkerId), center.X, center.Y);
+		}
+
+		// Residuals from the detected to the reprojected corners
+		for (int32 idx = 0; idx < FMath::Min(num_corners, marker.ReprojectedCorners.Num()); idx++)
+		{
+			canvas->K2_DrawLine(to_canvas(marker.Corners[idx]), to_canvas(marker.ReprojectedCorners[idx]), LINE_THICKNESS, RESIDUAL_COLOR);
+		}
+	}
+
+	for (FAURBoardOverlay const& board : Boards)
+	{
+		const FVector2D origin = to_canvas(board.Origin);
+		canvas->K2_DrawLine(origin, to_canvas(board.AxisX), LINE_THICKNESS, FLinearColor::Red);
+		canvas->K2_DrawLine(origin, to_canvas(board.AxisY), LINE_THICKNESS, FLinearColor::Green);
+		canvas->K2_DrawLine(origin, to_canvas(board.AxisZ), LINE_THICKNESS, FLinearColor::Blue);
+
+		canvas->SetDrawColor(FColor::White);
+		canvas->DrawText(GEngine->GetSmallFont(),
+			FString::Printf(TEXT("board %d: %.2f px"), board.BoardId, board.ReprojectionError), origin.X, origin.Y);
+	}
+
+	for (FVector2D const& pt : CalibrationPoints)
+	{
+		const FVector2D center = to_canvas(pt);
+		canvas->K2_DrawLine(center - FVector2D(POINT_MARK_SIZE, POINT_MARK_SIZE), center + FVector2D(POINT_MARK_SIZE, POINT_MARK_SIZE),
+			LINE_THICKNESS, CALIBRATION_POINT_COLOR);
+		canvas->K2_DrawLine(center - FVector2D(POINT_MARK_SIZE, -POINT_MARK_SIZE), center + FVector2D(POINT_MARK_SIZE, -POINT_MARK_SIZE),
+			LINE_THICKNESS, CALIBRATION_POINT_COLOR);
+	}
+}
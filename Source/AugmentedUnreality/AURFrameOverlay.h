@@ -0,0 +1,121 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AURFrameOverlay.generated.h"
+
+class UCanvas;
+
+// Marker found in a frame, coordinates are relative to the frame size (0..1)
+USTRUCT(BlueprintType)
+struct FAURMarkerOverlay
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 MarkerId;
+
+	// The first corner is the top-left corner of the marker's image
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<FVector2D> Corners;
+
+	// Corners projected with the estimated pose of the marker's board, empty if the board has no pose
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<FVector2D> ReprojectedCorners;
+
+	FAURMarkerOverlay()
+		: MarkerId(0)
+	{
+	}
+};
+
+// Axes of a detected board, coordinates are relative to the frame size (0..1)
+USTRUCT(BlueprintType)
+struct FAURBoardOverlay
+{
+	GENERATED_BODY()
+
+	// Lowest marker ID of the board
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 BoardId;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	FVector2D Origin;
+
+	// Ends of the board's axes, each as long as the side of a marker
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	FVector2D AxisX;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	FVector2D AxisY;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	FVector2D AxisZ;
+
+	// Mean distance between the detected and reprojected marker corners, in pixels of the captured frame
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	float ReprojectionError;
+
+	FAURBoardOverlay()
+		: BoardId(0)
+		, Origin(0, 0)
+		, AxisX(0, 0)
+		, AxisY(0, 0)
+		, AxisZ(0, 0)
+		, ReprojectionError(0)
+	{
+	}
+};
+
+/*
+	Diagnostic information about one frame, published with the frame instead of being drawn into it,
+	so that the video stays unmodified and the engine draws the overlay at any resolution.
+*/
+USTRUCT(BlueprintType)
+struct FAURFrameOverlay
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<FAURMarkerOverlay> Markers;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<FAURBoardOverlay> Boards;
+
+	// Points of the calibration pattern found during calibration
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<FVector2D> CalibrationPoints;
+
+	void Reset()
+	{
+		Markers.Reset();
+		Boards.Reset();
+		CalibrationPoints.Reset();
+	}
+
+	bool IsEmpty() const
+	{
+		return Markers.Num() == 0 && Boards.Num() == 0 && CalibrationPoints.Num() == 0;
+	}
+
+	// Visit all coordinates, for example to move them to the undistorted image
+	void ForEachPoint(TFunctionRef<void(FVector2D& point)> func);
+
+	// Draw with lines and labels over the frame shown in the rectangle at position with size, in canvas pixels
+	void Draw(UCanvas* canvas, FVector2D const& position, FVector2D const& size) const;
+};
@@ -0,0 +1,259 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURFrameProcessor.h"
+#include "AURLog.h"
+#include "Async/TaskGraphInterfaces.h"
+
+// Weight of the newest frame in the average stage duration
+static const float TIMING_AVERAGE_WEIGHT = 0.05;
+
+FAURFrameProcessorGraph::FAURFrameProcessorGraph()
+	: bProcessorsChanged(false)
+	, bHasProcessors(false)
+	, bUseTaskGraph(true)
+	, FrameNumber(0)
+{
+}
+
+bool FAURFrameProcessorGraph::AddProcessor(FAURFrameProcessorRef const& processor)
+{
+	FScopeLock lock(&ProcessorsLock);
+
+	const FName name = processor->GetName();
+	if (Processors.ContainsByPredicate([&](FAURFrameProcessorRef const& existing) { return existing->GetName() == name; }))
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURFrameProcessorGraph::AddProcessor: A stage named %s is already registered"), *name.ToString())
+		return false;
+	}
+
+	Processors.Add(processor);
+	bProcessorsChanged = true;
+	bHasProcessors.AtomicSet(true);
+	return true;
+}
+
+void FAURFrameProcessorGraph::RemoveProcessor(FName const& name)
+{
+	FScopeLock lock(&ProcessorsLock);
+
+	Processors.RemoveAll([&](FAURFrameProcessorRef const& existing) { return existing->GetName() == name; });
+	bProcessorsChanged = true;
+	bHasProcessors.AtomicSet(Processors.Num() > 0);
+}
+
+void FAURFrameProcessorGraph::RebuildStages()
+{
+	TArray<FAURFrameProcessorRef> processors;
+	{
+		FScopeLock lock(&ProcessorsLock);
+		if (!bProcessorsChanged)
+		{
+			return;
+		}
+		processors = Processors;
+		bProcessorsChanged = false;
+	}
+
+	Stages.Empty();
+
+	// Repeatedly take the stages whose dependencies are already placed
+	TArray<FAURFrameProcessorRef> remaining = processors;
+	bool progress = true;
+	while (remaining.Num() > 0 && progress)
+	{
+		progress = false;
+
+		for (int32 idx = 0; idx < remaining.Num(); idx++)
+		{
+			TArray<int32> dependency_indices;
+			bool dependencies_placed = true;
+
+			for (FName const& dependency : remaining[idx]->GetDependencies())
+			{
+				const int32 dep_idx = Stages.IndexOfByPredicate([&](FStage const& stage) { return stage.Name == dependency; });
+				if (dep_idx == INDEX_NONE)
+				{
+					dependencies_placed = false;
+					break;
+				}
+				dependency_indices.Add(dep_idx);
+			}
+
+			if (dependencies_placed)
+			{
+				FStage& stage = Stages[Stages.Emplace(remaining[idx])];
+				stage.DependencyIndices = dependency_indices;
+				stage.bAfterTracking = !stage.Processor->CanRunParallelToTracking();
+				for (int32 dep_idx : dependency_indices)
+				{
+					stage.bAfterTracking |= Stages[dep_idx].bAfterTracking;
+				}
+
+				remaining.RemoveAt(idx);
+				idx--;
+				progress = true;
+			}
+		}
+	}
+
+	for (auto const& processor : remaining)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURFrameProcessorGraph: Stage %s has missing or cyclic dependencies and will not run"),
+			*processor->GetName().ToString())
+	}
+
+	FScopeLock lock(&TimingLock);
+	Timings.SetNum(Stages.Num());
+	for (int32 idx = 0; idx < Stages.Num(); idx++)
+	{
+		Timings[idx] = FAURFrameProcessorTiming();
+		Timings[idx].Name = Stages[idx].Name;
+	}
+}
+
+void FAURFrameProcessorGraph::ProcessFrame(cv::Mat_<cv::Vec3b> const& image_bgr, cv::Mat_<uint8> const& image_grey, double timestamp, TFunctionRef<void()> tracking)
+{
+	RebuildStages();
+	FrameNumber++;
+
+	if (Stages.Num() == 0)
+	{
+		tracking();
+		return;
+	}
+
+	if (!bUseTaskGraph)
+	{
+		// Dependencies come first in Stages, so the order is valid also without the graph
+		for (int32 idx = 0; idx < Stages.Num(); idx++)
+		{
+			if (!Stages[idx].bAfterTracking)
+			{
+				RunStage(idx, image_bgr, image_grey, timestamp);
+			}
+		}
+
+		tracking();
+
+		for (int32 idx = 0; idx < Stages.Num(); idx++)
+		{
+			if (Stages[idx].bAfterTracking)
+			{
+				RunStage(idx, image_bgr, image_grey, timestamp);
+			}
+		}
+		return;
+	}
+
+	FGraphEventArray stage_events;
+	stage_events.SetNum(Stages.Num());
+
+	// The lambdas reference locals of this function, this is safe because we wait for all of them below
+	auto dispatch_stage = [&](int32 stage_idx) {
+		FGraphEventArray prerequisites;
+		for (int32 dep_idx : Stages[stage_idx].DependencyIndices)
+		{
+			prerequisites.Add(stage_events[dep_idx]);
+		}
+
+		stage_events[stage_idx] = FFunctionGraphTask::CreateAndDispatchWhenReady(
+			[this, stage_idx, &image_bgr, &image_grey, timestamp]() {
+				RunStage(stage_idx, image_bgr, image_grey, timestamp);
+			},
+			TStatId(), &prerequisites, ENamedThreads::AnyBackgroundThreadNormalTask
+		);
+	};
+
+	// Dependencies come first in Stages, so their events exist when a stage is dispatched
+	for (int32 idx = 0; idx < Stages.Num(); idx++)
+	{
+		if (!Stages[idx].bAfterTracking)
+		{
+			dispatch_stage(idx);
+		}
+	}
+
+	tracking();
+
+	for (int32 idx = 0; idx < Stages.Num(); idx++)
+	{
+		if (Stages[idx].bAfterTracking)
+		{
+			dispatch_stage(idx);
+		}
+	}
+
+	FTaskGraphInterface::Get().WaitUntilTasksComplete(stage_events);
+}
+
+void FAURFrameProcessorGraph::RunStage(int32 stage_idx, cv::Mat_<cv::Vec3b> const& image_bgr, cv::Mat_<uint8> const& image_grey, double timestamp)
+{
+	FStage& stage = Stages[stage_idx];
+	const double start_time = FPlatformTime::Seconds();
+
+	FAURFrameProcessorFrame frame;
+	frame.FrameNumber = FrameNumber;
+	frame.Timestamp = timestamp;
+
+	cv::Mat const& full_image = (stage.Processor->GetInputFormat() == EAURFrameProcessorInput::BGR) ? (cv::Mat const&)image_bgr : (cv::Mat const&)image_grey;
+	const cv::Rect full_region(cv::Point(0, 0), full_image.size());
+
+	cv::Rect region;
+	if (stage.Processor->GetRegionOfInterest(full_image.size(), region))
+	{
+		frame.Region = region & full_region;
+	}
+	else
+	{
+		frame.Region = full_region;
+	}
+
+	// A view into the image, not a copy
+	frame.Image = full_image(frame.Region);
+
+	// Dependencies have finished before this task started, their results are not written anymore
+	for (int32 dep_idx : stage.DependencyIndices)
+	{
+		frame.DependencyResults.Add(Stages[dep_idx].Name, Stages[dep_idx].Result);
+	}
+
+#if !PLATFORM_ANDROID
+	try
+	{
+#endif
+		stage.Processor->ProcessFrame(frame, stage.Result);
+#if !PLATFORM_ANDROID
+	}
+	catch (std::exception& exc)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURFrameProcessorGraph: Exception in stage %s:\n    %s"), *stage.Name.ToString(), UTF8_TO_TCHAR(exc.what()))
+	}
+#endif
+
+	const float duration_ms = (FPlatformTime::Seconds() - start_time) * 1000.0;
+
+	FScopeLock lock(&TimingLock);
+	FAURFrameProcessorTiming& timing = Timings[stage_idx];
+	timing.AverageMs = (timing.LastMs == 0) ? duration_ms : FMath::Lerp(timing.AverageMs, duration_ms, TIMING_AVERAGE_WEIGHT);
+	timing.LastMs = duration_ms;
+}
+
+TArray<FAURFrameProcessorTiming> FAURFrameProcessorGraph::GetTimings() const
+{
+	FScopeLock lock(&TimingLock);
+	return Timings;
+}
@@ -0,0 +1,190 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AUROpenCV.h"
+#include "AURFrameProcessor.generated.h"
+
+USTRUCT(BlueprintType)
+struct FAURFrameProcessorTiming
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	FName Name;
+
+	// Duration of the stage on the last frame (milliseconds)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	float LastMs;
+
+	// Running average of the duration (milliseconds)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	float AverageMs;
+
+	FAURFrameProcessorTiming()
+		: LastMs(0)
+		, AverageMs(0)
+	{
+	}
+};
+
+enum class EAURFrameProcessorInput : uint8
+{
+	// 8-bit grey image, the same one the tracker uses
+	Grey,
+	// The captured BGR image
+	BGR
+};
+
+/*
+	Data given to a stage for one frame.
+	The images are shared with the tracker and other stages, they must not be modified.
+*/
+struct FAURFrameProcessorFrame
+{
+	// Grey or BGR image, restricted to Region
+	cv::Mat Image;
+
+	// Part of the full frame contained in Image, in pixels
+	cv::Rect Region;
+
+	int64 FrameNumber;
+
+	// FPlatformTime::Seconds() when the frame was received
+	double Timestamp;
+
+	// Results of the stages listed in GetDependencies, by name
+	TMap<FName, cv::Mat> DependencyResults;
+};
+
+/*
+	Extra computation performed on each captured frame, registered with UAURDriverOpenCV::AddFrameProcessor.
+	ProcessFrame is called on a worker thread, different stages may run at the same time.
+*/
+class IAURFrameProcessor
+{
+public:
+	virtual ~IAURFrameProcessor() {}
+
+	// Unique name, used by other stages to depend on this one
+	virtual FName GetName() const = 0;
+
+	virtual EAURFrameProcessorInput GetInputFormat() const
+	{
+		return EAURFrameProcessorInput::Grey;
+	}
+
+	// Return true and set out_region to process only a part of the frame
+	virtual bool GetRegionOfInterest(cv::Size const& frame_size, cv::Rect& out_region) const
+	{
+		return false;
+	}
+
+	// Stages whose results are needed by this one, they are run first
+	virtual TArray<FName> GetDependencies() const
+	{
+		return TArray<FName>();
+	}
+
+	/*
+		True if the stage can run at the same time as marker detection.
+		Otherwise it starts after detection, for example to read tracking results.
+	*/
+	virtual bool CanRunParallelToTracking() const
+	{
+		return true;
+	}
+
+	/*
+		Process one frame. out_result is kept by the driver between frames, so its memory can be reused,
+		and is given to the stages which depend on this one.
+	*/
+	virtual void ProcessFrame(FAURFrameProcessorFrame const& frame, cv::Mat& out_result) = 0;
+};
+
+typedef TSharedRef<IAURFrameProcessor, ESPMode::ThreadSafe> FAURFrameProcessorRef;
+
+/*
+	Runs the registered stages as a dependency graph on the task graph threads,
+	while marker detection runs on the capture thread.
+*/
+class FAURFrameProcessorGraph
+{
+public:
+	FAURFrameProcessorGraph();
+
+	// Thread safe, the stage is used from the next frame on
+	bool AddProcessor(FAURFrameProcessorRef const& processor);
+	void RemoveProcessor(FName const& name);
+
+	bool HasProcessors() const
+	{
+		return bHasProcessors;
+	}
+
+	// If false, the stages run one after another on the thread calling ProcessFrame
+	void SetUseTaskGraph(bool use_task_graph)
+	{
+		bUseTaskGraph.AtomicSet(use_task_graph);
+	}
+
+	/*
+		Runs tracking on the calling thread and the stages on worker threads (or also on the calling thread, see SetUseTaskGraph),
+		returns when all of them are finished.
+	*/
+	void ProcessFrame(cv::Mat_<cv::Vec3b> const& image_bgr, cv::Mat_<uint8> const& image_grey, double timestamp, TFunctionRef<void()> tracking);
+
+	TArray<FAURFrameProcessorTiming> GetTimings() const;
+
+protected:
+	struct FStage
+	{
+		FAURFrameProcessorRef Processor;
+		FName Name;
+		TArray<int32> DependencyIndices;
+		// Must wait for tracking, itself or through a dependency
+		bool bAfterTracking;
+		cv::Mat Result;
+
+		FStage(FAURFrameProcessorRef const& processor)
+			: Processor(processor)
+			, Name(processor->GetName())
+			, bAfterTracking(false)
+		{
+		}
+	};
+
+	// Registered processors, changed from any thread
+	mutable FCriticalSection ProcessorsLock;
+	TArray<FAURFrameProcessorRef> Processors;
+	bool bProcessorsChanged;
+	FThreadSafeBool bHasProcessors;
+	FThreadSafeBool bUseTaskGraph;
+
+	// Stages in dependency order, used only by the capture thread
+	TArray<FStage> Stages;
+	int64 FrameNumber;
+
+	mutable FCriticalSection TimingLock;
+	TArray<FAURFrameProcessorTiming> Timings;
+
+	// Sort the stages so that dependencies come first, skip stages with missing or cyclic dependencies
+	void RebuildStages();
+
+	void RunStage(int32 stage_idx, cv::Mat_<cv::Vec3b> const& image_bgr, cv::Mat_<uint8> const& image_grey, double timestamp);
+};
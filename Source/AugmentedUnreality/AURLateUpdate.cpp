@@ -0,0 +1,187 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURLateUpdate.h"
+#include "AURLog.h"
+#include "tracking/AURArucoTracker.h"
+#include "Engine/Engine.h"
+#include "Engine/GameViewportClient.h"
+#include "SceneView.h"
+
+FAURLateUpdateViewExtension::FAURLateUpdateViewExtension(const FAutoRegister& auto_register, UObject* owner, FAURArucoTracker* tracker)
+	: FSceneViewExtensionBase(auto_register)
+	, Owner(owner)
+	, Tracker(tracker)
+	, bHasLatch(false)
+{
+}
+
+void FAURLateUpdateViewExtension::SetSettings(FAURLateUpdateSettings const& settings)
+{
+	Settings = settings;
+}
+
+bool FAURLateUpdateViewExtension::GetLastLatch(FAURLateUpdateLatch& out_latch) const
+{
+	FScopeLock lock(&LatchLock);
+	if (bHasLatch)
+	{
+		out_latch = LastLatch;
+	}
+	return bHasLatch;
+}
+
+bool FAURLateUpdateViewExtension::IsActiveThisFrame(FViewport* InViewport) const
+{
+	// Only the game viewport shows the tracked camera, not scene captures or editor viewports
+	return Settings.Mode != EAURLateUpdateMode::Disabled
+		&& InViewport && GEngine && GEngine->GameViewport && InViewport == GEngine->GameViewport->Viewport;
+}
+
+void FAURLateUpdateViewExtension::BeginRenderViewFamily(FSceneViewFamily& InViewFamily)
+{
+	FFrameState frame;
+	frame.Settings = Settings;
+
+	if (Owner.IsValid() && Tracker)
+	{
+		frame.MaxExtrapolation = Tracker->GetSettings().MaxPredictionTime;
+
+		if (Settings.bUpdateCamera)
+		{
+			frame.ViewpointHistory = Tracker->GetViewpointHistory();
+			frame.ViewpointGameTransform = Tracker->GetViewpointTransform();
+		}
+
+		TArray<FAURArucoTracker::FLateUpdateBoard> boards;
+		Tracker->GetLateUpdateBoards(boards);
+
+		TMap<int32, TSharedPtr<FLateUpdateManager, ESPMode::ThreadSafe>> late_updates;
+		for (FAURArucoTracker::FLateUpdateBoard const& board : boards)
+		{
+			USceneComponent* root = board.Actor->GetRootComponent();
+			if (!root)
+			{
+				continue;
+			}
+
+			TSharedPtr<FLateUpdateManager, ESPMode::ThreadSafe> late_update = BoardLateUpdates.FindRef(board.BoardId);
+			if (!late_update.IsValid())
+			{
+				late_update = MakeShared<FLateUpdateManager, ESPMode::ThreadSafe>();
+			}
+
+			// ActorToMove is placed in world space, so there is no parent transform
+			late_update->Setup(FTransform::Identity, root, false);
+			late_updates.Add(board.BoardId, late_update);
+
+			frame.Boards.Add({ board.BoardId, board.History, late_update, root->GetComponentTransform() });
+		}
+
+		// Managers of boards which are no longer late updated are released, the render thread keeps its own references
+		BoardLateUpdates = MoveTemp(late_updates);
+	}
+
+	ENQUEUE_RENDER_COMMAND(AURLateUpdateBeginFrame)(
+		[this, frame](FRHICommandListImmediate& RHICmdList)
+		{
+			RenderFrame = frame;
+		}
+	);
+}
+
+bool FAURLateUpdateViewExtension::LatchPose(FAURPoseHistory const& history, FFrameState const& frame, double time,
+	FTransform& out_transform, FAURPoseHistory::FSample& out_newest)
+{
+	if (!history.GetLatestSample(out_newest))
+	{
+		return false;
+	}
+
+	out_transform = out_newest.Filtered;
+
+	if (frame.Settings.Mode == EAURLateUpdateMode::PredictToRenderTime)
+	{
+		// Keep the newest pose if the history was overwritten meanwhile
+		history.GetPoseAtTime(time + frame.Settings.DisplayLatency, frame.MaxExtrapolation, out_transform);
+	}
+
+	return true;
+}
+
+void FAURLateUpdateViewExtension::PreRenderViewFamily_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneViewFamily& InViewFamily)
+{
+	FAURLateUpdateLatch latch;
+	latch.RenderFrameNumber = GFrameCounterRenderThread;
+	latch.LatchTime = FPlatformTime::Seconds();
+
+	FAURPoseHistory::FSample newest;
+
+	RenderFrame.bViewpointLatched = RenderFrame.ViewpointHistory.IsValid()
+		&& LatchPose(*RenderFrame.ViewpointHistory, RenderFrame, latch.LatchTime, RenderFrame.ViewpointLatchedTransform, newest);
+
+	if (RenderFrame.bViewpointLatched)
+	{
+		latch.bViewpointLatched = true;
+		latch.ViewpointSampleTime = newest.Time;
+		latch.ViewpointSampleIndex = newest.Index;
+		latch.bViewpointSamplePredicted = newest.bPredicted;
+		latch.ViewpointGameTransform = RenderFrame.ViewpointGameTransform;
+		latch.ViewpointLatchedTransform = RenderFrame.ViewpointLatchedTransform;
+	}
+
+	for (FBoardTarget const& board : RenderFrame.Boards)
+	{
+		FTransform board_transform;
+		if (board.History.IsValid() && LatchPose(*board.History, RenderFrame, latch.LatchTime, board_transform, newest))
+		{
+			board.LateUpdate->Apply_RenderThread(InViewFamily.Scene, board.GameTransform, board_transform);
+			latch.Boards.Add({ board.BoardId, newest.Time, newest.Index, newest.bPredicted, board.GameTransform, board_transform });
+		}
+	}
+
+	UE_LOG(LogAUR, VeryVerbose, TEXT("AURLateUpdate: frame %llu viewpoint sample %lld (t=%.4f), %d boards"),
+		latch.RenderFrameNumber, latch.ViewpointSampleIndex, latch.ViewpointSampleTime, latch.Boards.Num())
+
+	FScopeLock lock(&LatchLock);
+	LastLatch = MoveTemp(latch);
+	bHasLatch = true;
+}
+
+void FAURLateUpdateViewExtension::PreRenderView_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneView& InView)
+{
+	if (!RenderFrame.bViewpointLatched)
+	{
+		return;
+	}
+
+	// Move the view by the difference between the pose it was set up with and the latched one, same as XR late update
+	const FQuat delta_rotation = RenderFrame.ViewpointGameTransform.GetRotation().Inverse() * RenderFrame.ViewpointLatchedTransform.GetRotation();
+	InView.ViewRotation = FRotator(InView.ViewRotation.Quaternion() * delta_rotation);
+	InView.ViewLocation += RenderFrame.ViewpointLatchedTransform.GetLocation() - RenderFrame.ViewpointGameTransform.GetLocation();
+	InView.UpdateViewMatrix();
+}
+
+void FAURLateUpdateViewExtension::PostRenderViewFamily_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneViewFamily& InViewFamily)
+{
+	// Every manager which was Setup for this frame advances to the next one
+	for (FBoardTarget const& board : RenderFrame.Boards)
+	{
+		board.LateUpdate->PostRender_RenderThread();
+	}
+
+	RenderFrame = FFrameState();
+}
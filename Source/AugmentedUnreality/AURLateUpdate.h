@@ -0,0 +1,186 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneViewExtension.h"
+#include "LateUpdateManager.h"
+#include "tracking/AURPoseHistory.h"
+#include "AURLateUpdate.generated.h"
+
+class FAURArucoTracker;
+
+UENUM(BlueprintType)
+enum class EAURLateUpdateMode : uint8
+{
+	// Render with the poses published on the game thread
+	Disabled,
+	// Replace them with the newest measured poses when the render thread starts the frame
+	NewestPose,
+	// Extrapolate the poses to the time the frame is displayed, does not fit the simulated clock of the synchronous mode
+	PredictToRenderTime
+};
+
+USTRUCT(BlueprintType)
+struct FAURLateUpdateSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	EAURLateUpdateMode Mode;
+
+	// Correct the view of the game viewport, assumes the camera is placed at the transform from OnViewpointTransformUpdate
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bUpdateCamera;
+
+	// Time (seconds) from the start of rendering until the frame is displayed, for PredictToRenderTime
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float DisplayLatency;
+
+	FAURLateUpdateSettings()
+		: Mode(EAURLateUpdateMode::Disabled)
+		, bUpdateCamera(true)
+		, DisplayLatency(0.016)
+	{
+	}
+};
+
+// Poses latched by the render thread for one frame, to check that rendering used the newest measurements
+struct FAURLateUpdateLatch
+{
+	struct FBoardLatch
+	{
+		int32 BoardId;
+		// Newest sample in the board's history at the latch, the pose is this sample or extrapolated from it
+		double SampleTime;
+		int64 SampleIndex;
+		// The sample was predicted on a frame without detection
+		bool bSamplePredicted;
+		// Transform of ActorToMove on the game thread and the one it was rendered with
+		FTransform GameTransform;
+		FTransform LatchedTransform;
+	};
+
+	// GFrameCounterRenderThread of the frame
+	uint64 RenderFrameNumber;
+	// FPlatformTime::Seconds() when the poses were read
+	double LatchTime;
+
+	bool bViewpointLatched;
+	double ViewpointSampleTime;
+	int64 ViewpointSampleIndex;
+	bool bViewpointSamplePredicted;
+	FTransform ViewpointGameTransform;
+	FTransform ViewpointLatchedTransform;
+
+	TArray<FBoardLatch> Boards;
+
+	FAURLateUpdateLatch()
+		: RenderFrameNumber(0)
+		, LatchTime(0)
+		, bViewpointLatched(false)
+		, ViewpointSampleTime(0)
+		, ViewpointSampleIndex(-1)
+		, bViewpointSamplePredicted(false)
+		, ViewpointGameTransform(FTransform::Identity)
+		, ViewpointLatchedTransform(FTransform::Identity)
+	{
+	}
+};
+
+/*
+	Like the late update of XR devices: the game thread places the camera and the boards' ActorToMove
+	with the poses published on its tick, then just before the view is set up the render thread
+	reads the newest poses from the pose histories and moves the view and the primitives of those actors by the difference.
+	This hides the game frame between publishing and rendering.
+*/
+class FAURLateUpdateViewExtension : public FSceneViewExtensionBase
+{
+public:
+	// tracker is owned by owner and only used on the game thread while owner is valid
+	FAURLateUpdateViewExtension(const FAutoRegister& auto_register, UObject* owner, FAURArucoTracker* tracker);
+
+	// Game thread, applies from the next rendered frame
+	void SetSettings(FAURLateUpdateSettings const& settings);
+
+	// Any thread, returns false if no frame was latched yet
+	bool GetLastLatch(FAURLateUpdateLatch& out_latch) const;
+
+	// Begin ISceneViewExtension interface
+	virtual void SetupViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override {}
+	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override;
+	virtual void PreRenderViewFamily_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneViewFamily& InViewFamily) override;
+	virtual void PreRenderView_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneView& InView) override;
+	virtual void PostRenderViewFamily_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneViewFamily& InViewFamily) override;
+	virtual bool IsActiveThisFrame(class FViewport* InViewport) const override;
+	// End ISceneViewExtension interface
+
+protected:
+	struct FBoardTarget
+	{
+		int32 BoardId;
+		TSharedPtr<FAURPoseHistory, ESPMode::ThreadSafe> History;
+		TSharedPtr<FLateUpdateManager, ESPMode::ThreadSafe> LateUpdate;
+		FTransform GameTransform;
+	};
+
+	// Captured by the game thread for one view family, then owned by the render thread
+	struct FFrameState
+	{
+		FAURLateUpdateSettings Settings;
+		float MaxExtrapolation;
+
+		TSharedPtr<FAURPoseHistory, ESPMode::ThreadSafe> ViewpointHistory;
+		FTransform ViewpointGameTransform;
+
+		TArray<FBoardTarget> Boards;
+
+		// Set by the render thread in PreRenderViewFamily_RenderThread
+		bool bViewpointLatched;
+		FTransform ViewpointLatchedTransform;
+
+		FFrameState()
+			: MaxExtrapolation(0)
+			, ViewpointGameTransform(FTransform::Identity)
+			, bViewpointLatched(false)
+			, ViewpointLatchedTransform(FTransform::Identity)
+		{
+		}
+	};
+
+	// Game thread
+	TWeakObjectPtr<UObject> Owner;
+	FAURArucoTracker* Tracker;
+	FAURLateUpdateSettings Settings;
+	// Kept between frames, FLateUpdateManager double-buffers the primitives gathered on the game thread
+	TMap<int32, TSharedPtr<FLateUpdateManager, ESPMode::ThreadSafe>> BoardLateUpdates;
+
+	// Render thread
+	FFrameState RenderFrame;
+
+	mutable FCriticalSection LatchLock;
+	FAURLateUpdateLatch LastLatch;
+	bool bHasLatch;
+
+	/*
+		Newest pose of the history, or extrapolated to time for PredictToRenderTime.
+		Returns false if the history is empty.
+	*/
+	static bool LatchPose(FAURPoseHistory const& history, FFrameState const& frame, double time,
+		FTransform& out_transform, FAURPoseHistory::FSample& out_newest);
+};
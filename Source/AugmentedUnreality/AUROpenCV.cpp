@@ -16,8 +16,11 @@ limitations under the License.
 
 #include "AUROpenCV.h"
 #include "AURLog.h"
+#include "AURThreading.h"
 
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
 #if PLATFORM_WINDOWS
 // windows has renamed the setenv func to _putenv_s
 int setenv(const char *name, const char *value, int overwrite)
@@ -89,3 +92,93 @@ void FAUROpenCV::SetGstreamerPluginEnv()
 		setenv("GST_PLUGIN_PATH", TCHAR_TO_UTF8(*gst_plugin_dir), 0);
 	}
 }
+
+void FAUROpenCV::ConvertBGRToColor(cv::Mat_<cv::Vec3b> const& src, FColor* dest)
+{
+	FColor* dest_pixel_ptr = dest;
+
+	for (int32 pixel_r = 0; pixel_r < src.rows; pixel_r++)
+	{
+		cv::Vec3b const* src_pixel = src[pixel_r];
+
+		for (int32 pixel_c = 0; pixel_c < src.cols; pixel_c++)
+		{
+			// Captured image is in BGR format
+			dest_pixel_ptr->R = src_pixel->val[2];
+			dest_pixel_ptr->G = src_pixel->val[1];
+			dest_pixel_ptr->B = src_pixel->val[0];
+			dest_pixel_ptr->A = 255;
+
+			dest_pixel_ptr++;
+			src_pixel++;
+		}
+	}
+}
+
+void FAUROpenCV::ConvertBGRToColorDownscaled(cv::Mat_<cv::Vec3b> const& src, FIntPoint const& dest_resolution, FColor* dest)
+{
+	if (dest_resolution.X == src.cols && dest_resolution.Y == src.rows)
+	{
+		ConvertBGRToColor(src, dest);
+		return;
+	}
+
+	const int32 src_cols = src.cols;
+	const int32 src_rows = src.rows;
+	const int32 dest_cols = FMath::Clamp(dest_resolution.X, 1, src_cols);
+	const int32 dest_rows = FMath::Clamp(dest_resolution.Y, 1, src_rows);
+
+	// Source column range of each output column
+	std::vector<int32> col_bounds(dest_cols + 1);
+	for (int32 c = 0; c <= dest_cols; c++)
+	{
+		col_bounds[c] = int32((int64(c) * src_cols) / dest_cols);
+	}
+
+	FAURThreading::ParallelFor(dest_rows, [&](int32 rows_begin, int32 rows_end) {
+		// Sum of the box rows, per source channel - a plain loop over contiguous bytes which the compiler vectorizes
+		std::vector<uint32> row_sum(src_cols * 3);
+
+		for (int32 dest_r = rows_begin; dest_r < rows_end; dest_r++)
+		{
+			const int32 src_r_begin = int32((int64(dest_r) * src_rows) / dest_rows);
+			const int32 src_r_end = int32((int64(dest_r + 1) * src_rows) / dest_rows);
+
+			std::fill(row_sum.begin(), row_sum.end(), 0u);
+			for (int32 src_r = src_r_begin; src_r < src_r_end; src_r++)
+			{
+				uint8 const* src_row = src.ptr<uint8>(src_r);
+				uint32* sum_ptr = row_sum.data();
+				for (int32 idx = 0; idx < src_cols * 3; idx++)
+				{
+					sum_ptr[idx] += src_row[idx];
+				}
+			}
+
+			FColor* dest_pixel_ptr = dest + int64(dest_r) * dest_cols;
+			const uint32 box_rows = src_r_end - src_r_begin;
+
+			for (int32 dest_c = 0; dest_c < dest_cols; dest_c++)
+			{
+				uint32 b = 0, g = 0, r = 0;
+				for (int32 src_c = col_bounds[dest_c]; src_c < col_bounds[dest_c + 1]; src_c++)
+				{
+					b += row_sum[3 * src_c + 0];
+					g += row_sum[3 * src_c + 1];
+					r += row_sum[3 * src_c + 2];
+				}
+
+				const uint32 box_area = box_rows * (col_bounds[dest_c + 1] - col_bounds[dest_c]);
+				const uint32 half = box_area / 2;
+
+				// Captured image is in BGR format
+				dest_pixel_ptr->R = uint8((r + half) / box_area);
+				dest_pixel_ptr->G = uint8((g + half) / box_area);
+				dest_pixel_ptr->B = uint8((b + half) / box_area);
+				dest_pixel_ptr->A = 255;
+
+				dest_pixel_ptr++;
+			}
+		}
+	});
+}
@@ -84,4 +84,14 @@ public:
 	}
 
 	static void SetGstreamerPluginEnv();
+
+	// Converts a BGR frame to the RGBA layout of FColor, dest must have room for all pixels of src
+	static void ConvertBGRToColor(cv::Mat_<cv::Vec3b> const& src, FColor* dest);
+
+	/*
+		Averages src over boxes (area downscale) and writes the result in the layout of FColor,
+		without an intermediate BGR image. dest must have room for dest_resolution pixels.
+		Rows of the output are processed in parallel.
+	*/
+	static void ConvertBGRToColorDownscaled(cv::Mat_<cv::Vec3b> const& src, FIntPoint const& dest_resolution, FColor* dest);
 };
@@ -16,8 +16,57 @@ limitations under the License.
 
 #include "AUROpenCVCalibration.h"
 #include "AURLog.h"
+#include "Async/TaskGraphInterfaces.h"
 #include <sstream>
 
+// Size of the region searched around the previous detection, relative to the size of that detection
+static const float PREVIOUS_DETECTION_MARGIN = 0.5;
+
+// Half size of the window in which a circle's centroid is computed, relative to the distance of neighbouring circles.
+// Small enough that the window's corners do not reach the diagonal neighbours.
+static const float CENTROID_WINDOW_RATIO = 0.3;
+
+// Views are binned by the tilt of the pattern: facing the camera, tilted by 15-35 degrees or more, the tilted ones in 4 directions
+static const float TILT_SMALL_DEG = 15.0;
+static const float TILT_LARGE_DEG = 35.0;
+static const int32 NUM_TILT_DIRECTIONS = 4;
+static const int32 NUM_TILT_BINS = 1 + 2 * NUM_TILT_DIRECTIONS;
+
+// Views are binned by the size of the pattern relative to the image, far / middle / near
+static const float DISTANCE_BIN_LIMITS[] = { 0.2, 0.4 };
+static const int32 NUM_DISTANCE_BINS = 3;
+
+// Scaled copy of image with the longer side at most max_size, returns the scale applied
+static float DownscaleForSearch(cv::Mat const& image, int32 max_size, cv::Mat& out_image)
+{
+	const int32 longer_side = FMath::Max(image.cols, image.rows);
+	if (longer_side <= max_size)
+	{
+		out_image = image;
+		return 1.0;
+	}
+
+	const double scale = double(max_size) / double(longer_side);
+	cv::resize(image, out_image, cv::Size(), scale, scale, cv::INTER_AREA);
+	return scale;
+}
+
+// Search a downscaled image, the points are returned in the coordinates of the full frame
+static bool FindCirclesScaled(cv::Mat const& image, float scale, cv::Point2f const& offset, cv::Size const& pattern_size,
+	std::vector<cv::Point2f>& out_points)
+{
+	if (!cv::findCirclesGrid(image, pattern_size, out_points, cv::CALIB_CB_ASYMMETRIC_GRID))
+	{
+		return false;
+	}
+
+	for (cv::Point2f& pt : out_points)
+	{
+		pt = pt * (1.0f / scale) + offset;
+	}
+	return true;
+}
+
 const char* FOpenCVCameraProperties::KEY_RESOLUTION = "Resolution";
 const char* FOpenCVCameraProperties::KEY_CAMERA_MATRIX = "CameraMatrix";
 const char* FOpenCVCameraProperties::KEY_DISTORTION = "DistortionCoefficients";
@@ -225,105 +274,716 @@ void FOpenCVCameraProperties::PrintToLog() const
 #endif
 }
 
+FOpenCVCameraCalibrationProcess::FState::FState()
+	: Generation(0)
+	, FramesCollected(0)
+	, LastFrameTime(0)
+	, Resolution(0, 0)
+	, bSearching(false)
+	, bIncrementalSolving(false)
+	, bFinalSolveStarted(false)
+	, bFinished(false)
+	, bFailed(false)
+	, LastCoverageGainTime(0)
+	, CalibrationError(-1.0)
+	, FocalUncertainty(-1.0)
+{
+}
+
 FOpenCVCameraCalibrationProcess::FOpenCVCameraCalibrationProcess()
-	: FramesNeeded(25)
-	, MinInterval(0.75)
-	, PatternSize(4, 11)
-	, SquareSize(1.7) // cm if printed on A4 paper
-	, CalibrationFlags(
+	: State(MakeShared<FState, ESPMode::ThreadSafe>())
+{
+	Config.FramesNeeded = 25;
+	// Similar views are rejected by the coverage, so they can be taken more often
+	Config.MinInterval = 0.3;
+	Config.PatternSize = cv::Size(4, 11);
+	Config.SquareSize = 1.7; // cm if printed on A4 paper
+	Config.CalibrationFlags =
 		cv::CALIB_FIX_K4 |
 		cv::CALIB_FIX_K5 |
 		cv::CALIB_FIX_PRINCIPAL_POINT |
 		cv::CALIB_ZERO_TANGENT_DIST |
-		cv::CALIB_FIX_ASPECT_RATIO
-	)
-{
+		cv::CALIB_FIX_ASPECT_RATIO;
+	Config.IncrementalSolveInterval = 3;
+	Config.MinCharucoCorners = 8;
+	Config.SearchMaxSize = 960;
+	Config.MinContrast = 12.0;
+	Config.MinSharpness = 15.0;
+	Config.MinPatternSharpness = 30.0;
+	Config.CoverageGridSize = 4;
+	Config.CoverageTarget = 2;
+	Config.CoverageStallTime = 5.0;
+	Config.MaxFocalUncertainty = 0.005;
+	Config.MinFramesToStop = 6;
+
 	Reset();
 }
 
 void FOpenCVCameraCalibrationProcess::Reset()
 {
-	FramesCollected = 0;
-	LastFrameTime = 0;
-	DetectedPointSets.clear();
+	FScopeLock lock(&State->Lock);
+
+	State->Generation++;
+	ClearViews(*State);
+	State->LastDetectedPoints.clear();
+	State->LastFrameTime = 0;
+	State->bFinalSolveStarted = false;
+	State->bFinished = false;
+	State->bFailed = false;
+	State->CalibrationError = -1.0;
+	State->FocalUncertainty = -1.0;
+	// bSearching and bIncrementalSolving are cleared by their tasks, which still own their data
 }
 
-bool FOpenCVCameraCalibrationProcess::ProcessFrame(cv::Mat& frame, float time_now)
+bool FOpenCVCameraCalibrationProcess::ProcessFrame(cv::Mat const& frame, float time_now)
 {
-	// Store the captured frame if enough time has passed since the last was captured
-	if (time_now >= LastFrameTime + MinInterval)
+	int32 generation;
 	{
-		cv::Mat new_calib_points;
+		FScopeLock lock(&State->Lock);
+
+		// Store the captured frame if enough time has passed since the last was captured
+		if (State->bSearching || State->bFinalSolveStarted || time_now < State->LastFrameTime + Config.MinInterval)
+		{
+			return false;
+		}
 
 		// Derive resolution from the given frame
-		auto frame_size = frame.size();
-		CameraProperties.SetResolution(FIntPoint(frame_size.width, frame_size.height));
+		State->Resolution = FIntPoint(frame.cols, frame.rows);
+
+		// Reuses the buffer of the previous search
+		frame.copyTo(State->SearchFrame);
+		State->bSearching = true;
+		generation = State->Generation;
+	}
+
+	FStateRef state = State;
+	FConfig config = Config;
+	FFunctionGraphTask::CreateAndDispatchWhenReady(
+		[state, config, generation, time_now]() {
+			SearchFrame(state, config, generation, time_now);
+		},
+		TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask
+	);
+
+	return true;
+}
+
+void FOpenCVCameraCalibrationProcess::SearchFrame(FStateRef const& state, FConfig const& config, int32 generation, float time_now)
+{
+	std::vector<cv::Point2f> previous_points;
+	{
+		FScopeLock lock(&state->Lock);
+		previous_points = state->LastDetectedPoints;
+	}
+
+	// SearchFrame is not touched by other threads while bSearching is set
+	std::vector<cv::Point2f> new_calib_points;
+	FViewCoverage coverage;
+	bool found = false;
+
+#if !PLATFORM_ANDROID
+	try
+	{
+#endif
+		cv::Mat frame_grey;
+		if (state->SearchFrame.channels() == 3)
+		{
+			cv::cvtColor(state->SearchFrame, frame_grey, cv::COLOR_BGR2GRAY);
+		}
+		else
+		{
+			frame_grey = state->SearchFrame;
+		}
 
 		// Detect point positions in the given frame
-		bool found = cv::findCirclesGrid(frame, PatternSize, new_calib_points, cv::CALIB_CB_ASYMMETRIC_GRID);
+		found = FindPattern(frame_grey, config, previous_points, new_calib_points);
 
 		if (found)
 		{
-			// Draw to show that we have found the points
-			cv::drawChessboardCorners(frame, PatternSize, new_calib_points, found);
+			MeasureCoverage(config, new_calib_points, GetCirclesObjectPoints(config), frame_grey, coverage);
+		}
+#if !PLATFORM_ANDROID
+	}
+	catch (std::exception& exc)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FOpenCVCameraCalibrationProcess: exception in pattern search\n    %s"), UTF8_TO_TCHAR(exc.what()))
+	}
+#endif
+
+	FScopeLock lock(&state->Lock);
+	state->bSearching = false;
+
+	// Reset was called during the search
+	if (state->Generation != generation || state->bFinalSolveStarted)
+	{
+		return;
+	}
+
+	// Shown by the driver's overlay, the frame is not drawn on
+	state->LastDetectedPoints.clear();
+
+	if (!found)
+	{
+		return;
+	}
+
+	// Views of a ChArUco board collected before can not be combined with the circles
+	if (state->CharucoBoard)
+	{
+		ClearViews(*state);
+	}
+
+	state->LastDetectedPoints = new_calib_points;
+
+	if (!ShouldCollectView(*state, config, coverage, time_now))
+	{
+		return;
+	}
+
+	// Copied, the Mat would otherwise point into the vector
+	state->DetectedPointSets.push_back(cv::Mat(new_calib_points, true));
+
+	AddView(state, config, generation, coverage, time_now);
+}
+
+bool FOpenCVCameraCalibrationProcess::ProcessCharucoCorners(cv::Mat const& frame, std::vector<cv::Point2f> const& corners, std::vector<int> const& ids,
+	cv::Ptr<cv::aruco::CharucoBoard> const& board, float time_now)
+{
+	{
+		FScopeLock lock(&State->Lock);
+
+		if (State->bFinalSolveStarted)
+		{
+			return false;
+		}
+
+		// Shown by the driver's overlay like the circles, on every frame
+		State->LastDetectedPoints = corners;
+
+		// Partial views are fine, but too few corners hardly constrain the camera
+		if (!board || int32(corners.size()) < Config.MinCharucoCorners || corners.size() != ids.size()
+			|| time_now < State->LastFrameTime + Config.MinInterval)
+		{
+			return false;
+		}
+	}
+
+	// Outside of the lock, the background solves do not wait for it
+	std::vector<cv::Point3f> object_points;
+	object_points.reserve(ids.size());
+	for (int corner_id : ids)
+	{
+		object_points.push_back(board->chessboardCorners[corner_id]);
+	}
+
+	FViewCoverage coverage;
+	MeasureCoverage(Config, corners, object_points, frame, coverage);
+
+	FScopeLock lock(&State->Lock);
+
+	if (State->bFinalSolveStarted)
+	{
+		return false;
+	}
+
+	// Corners of different boards (or circles) can not be combined
+	if (State->CharucoBoard != board)
+	{
+		ClearViews(*State);
+		State->CharucoBoard = board;
+	}
+
+	if (!ShouldCollectView(*State, Config, coverage, time_now))
+	{
+		return false;
+	}
+
+	State->Resolution = FIntPoint(frame.cols, frame.rows);
+	State->DetectedPointSets.push_back(cv::Mat(corners, true));
+	State->DetectedIdSets.push_back(cv::Mat(ids, true));
+
+	AddView(State, Config, State->Generation, coverage, time_now);
+	return true;
+}
+
+std::vector<cv::Point3f> FOpenCVCameraCalibrationProcess::GetCirclesObjectPoints(FConfig const& config)
+{
+	std::vector<cv::Point3f> object_points;
+	for (int8 col = 0; col < config.PatternSize.height; col++)
+	{
+		for (int8 row = 0; row < config.PatternSize.width; row++)
+		{
+			object_points.push_back(cv::Point3f(
+				config.SquareSize * float(2 * row + col % 2),
+				config.SquareSize * float(col),
+				0));
+		}
+	}
+	return object_points;
+}
+
+void FOpenCVCameraCalibrationProcess::MeasureCoverage(FConfig const& config, std::vector<cv::Point2f> const& image_points,
+	std::vector<cv::Point3f> const& object_points, cv::Mat const& frame, FViewCoverage& out_coverage)
+{
+	const cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+	if (image_points.size() < 4 || image_points.size() != object_points.size() || frame_rect.area() <= 0)
+	{
+		return;
+	}
+
+#if !PLATFORM_ANDROID
+	try
+	{
+#endif
+		for (cv::Point2f const& pt : image_points)
+		{
+			const int32 cell_x = FMath::Clamp(int32(pt.x * config.CoverageGridSize / frame.cols), 0, config.CoverageGridSize - 1);
+			const int32 cell_y = FMath::Clamp(int32(pt.y * config.CoverageGridSize / frame.rows), 0, config.CoverageGridSize - 1);
+			out_coverage.Cells.AddUnique(cell_y * config.CoverageGridSize + cell_x);
+		}
+
+		// Distance from the apparent size of the pattern
+		std::vector<cv::Point2f> hull;
+		cv::convexHull(image_points, hull);
+		const float relative_size = FMath::Sqrt(float(cv::contourArea(hull)) / float(frame_rect.area()));
+		out_coverage.DistanceBin = 0;
+		while (out_coverage.DistanceBin < NUM_DISTANCE_BINS - 1 && relative_size > DISTANCE_BIN_LIMITS[out_coverage.DistanceBin])
+		{
+			out_coverage.DistanceBin++;
+		}
 
-			DetectedPointSets.push_back(new_calib_points);
-			FramesCollected += 1;
-			LastFrameTime = time_now;
+		// Tilt from the homography between the pattern plane and the image, with a guessed camera matrix.
+		// Only used for binning, so the guess does not need to be accurate.
+		std::vector<cv::Point2f> object_plane;
+		object_plane.reserve(object_points.size());
+		for (cv::Point3f const& pt : object_points)
+		{
+			object_plane.push_back(cv::Point2f(pt.x, pt.y));
+		}
 
-			UE_LOG(LogAUR, Log, TEXT("FOpenCVCameraCalibrationProcess: Recorded %d/%d"), FramesCollected, FramesNeeded)
+		const cv::Mat homography = cv::findHomography(object_plane, image_points);
+		if (!homography.empty())
+		{
+			const double focal_guess = FMath::Max(frame.cols, frame.rows);
+			cv::Matx33d camera_guess(
+				focal_guess, 0, frame.cols * 0.5,
+				0, focal_guess, frame.rows * 0.5,
+				0, 0, 1);
+
+			const cv::Matx33d plane_to_camera = camera_guess.inv() * cv::Matx33d(homography);
+			cv::Vec3d axis_x(plane_to_camera(0, 0), plane_to_camera(1, 0), plane_to_camera(2, 0));
+			cv::Vec3d axis_y(plane_to_camera(0, 1), plane_to_camera(1, 1), plane_to_camera(2, 1));
+			cv::Vec3d normal = cv::normalize(cv::normalize(axis_x).cross(cv::normalize(axis_y)));
+			if (normal[2] < 0)
+			{
+				normal = -normal;
+			}
 
-			// Have enough frames, finish the calibration
-			if (FramesCollected >= FramesNeeded)
+			const float tilt_deg = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(float(normal[2]), -1.0f, 1.0f)));
+			if (tilt_deg >= TILT_SMALL_DEG)
 			{
-				this->CalculateCalibration();
+				const float direction = FMath::Atan2(float(normal[1]), float(normal[0])) + PI;
+				const int32 direction_idx = FMath::Clamp(int32(direction / (2 * PI) * NUM_TILT_DIRECTIONS), 0, NUM_TILT_DIRECTIONS - 1);
+				out_coverage.TiltBin = 1 + direction_idx + (tilt_deg >= TILT_LARGE_DEG ? NUM_TILT_DIRECTIONS : 0);
 			}
 		}
 
-		return found;
+		// Sharpness around the pattern, at full resolution
+		const cv::Rect pattern_rect = cv::boundingRect(image_points) & frame_rect;
+		if (pattern_rect.area() > 0)
+		{
+			cv::Mat pattern_grey;
+			if (frame.channels() == 3)
+			{
+				cv::cvtColor(frame(pattern_rect), pattern_grey, cv::COLOR_BGR2GRAY);
+			}
+			else
+			{
+				pattern_grey = frame(pattern_rect);
+			}
+
+			cv::Mat laplacian;
+			cv::Laplacian(pattern_grey, laplacian, CV_16S);
+
+			cv::Scalar mean, stddev;
+			cv::meanStdDev(laplacian, mean, stddev);
+			out_coverage.Sharpness = stddev[0] * stddev[0];
+		}
+#if !PLATFORM_ANDROID
+	}
+	catch (std::exception& exc)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FOpenCVCameraCalibrationProcess: exception while measuring a view\n    %s"), UTF8_TO_TCHAR(exc.what()))
+	}
+#endif
+}
+
+int32 FOpenCVCameraCalibrationProcess::CountCoverageGain(FState const& state, FConfig const& config, FViewCoverage const& coverage)
+{
+	auto is_lacking = [&](TArray<int32> const& counts, int32 idx) {
+		return !counts.IsValidIndex(idx) || counts[idx] < config.CoverageTarget;
+	};
+
+	int32 gain = 0;
+	for (int32 cell : coverage.Cells)
+	{
+		gain += is_lacking(state.CellCounts, cell) ? 1 : 0;
+	}
+	gain += is_lacking(state.TiltCounts, coverage.TiltBin) ? 1 : 0;
+	gain += is_lacking(state.DistanceCounts, coverage.DistanceBin) ? 1 : 0;
+	return gain;
+}
+
+bool FOpenCVCameraCalibrationProcess::ShouldCollectView(FState const& state, FConfig const& config, FViewCoverage const& coverage, float time_now)
+{
+	if (coverage.Sharpness < config.MinPatternSharpness)
+	{
+		return false;
+	}
+
+	// Similar views would only enlarge the solve, unless nothing new was shown for a while
+	return CountCoverageGain(state, config, coverage) > 0 || time_now > state.LastCoverageGainTime + config.CoverageStallTime;
+}
+
+void FOpenCVCameraCalibrationProcess::ClearViews(FState& state)
+{
+	state.DetectedPointSets.clear();
+	state.DetectedIdSets.clear();
+	state.CharucoBoard.release();
+	state.FramesCollected = 0;
+	state.CellCounts.Reset();
+	state.TiltCounts.Reset();
+	state.DistanceCounts.Reset();
+	state.LastCoverageGainTime = 0;
+}
+
+void FOpenCVCameraCalibrationProcess::AddView(FStateRef const& state, FConfig const& config, int32 generation, FViewCoverage const& coverage, float time_now)
+{
+	if (CountCoverageGain(*state, config, coverage) > 0)
+	{
+		state->LastCoverageGainTime = time_now;
+	}
+
+	const int32 num_cells = config.CoverageGridSize * config.CoverageGridSize;
+	if (state->CellCounts.Num() != num_cells)
+	{
+		state->CellCounts.Init(0, num_cells);
+		state->TiltCounts.Init(0, NUM_TILT_BINS);
+		state->DistanceCounts.Init(0, NUM_DISTANCE_BINS);
+	}
+
+	for (int32 cell : coverage.Cells)
+	{
+		state->CellCounts[cell]++;
+	}
+	state->TiltCounts[coverage.TiltBin]++;
+	state->DistanceCounts[coverage.DistanceBin]++;
+
+	state->FramesCollected += 1;
+	state->LastFrameTime = time_now;
+
+	UE_LOG(LogAUR, Log, TEXT("FOpenCVCameraCalibrationProcess: Recorded %d/%d (tilt bin %d, distance bin %d, sharpness %.0f)"),
+		state->FramesCollected, config.FramesNeeded, coverage.TiltBin, coverage.DistanceBin, coverage.Sharpness)
+
+	// Have the most frames allowed, finish the calibration. Usually the incremental solves converge before.
+	const bool final = state->FramesCollected >= config.FramesNeeded;
+	const bool incremental = !final && !state->bIncrementalSolving && config.IncrementalSolveInterval > 0
+		&& state->FramesCollected % config.IncrementalSolveInterval == 0;
+
+	if (final || incremental)
+	{
+		if (final)
+		{
+			state->bFinalSolveStarted = true;
+		}
+		else
+		{
+			state->bIncrementalSolving = true;
+		}
+
+		// The solve gets its own copy of the views, the vectors can grow meanwhile
+		FViews views;
+		views.PointSets = state->DetectedPointSets;
+		views.IdSets = state->DetectedIdSets;
+		views.CharucoBoard = state->CharucoBoard;
+		views.Resolution = state->Resolution;
+
+		FFunctionGraphTask::CreateAndDispatchWhenReady(
+			[state, config, generation, views, final]() {
+				Solve(state, config, generation, views, final);
+			},
+			TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask
+		);
+	}
+}
+
+bool FOpenCVCameraCalibrationProcess::FindPattern(cv::Mat const& frame_grey, FConfig const& config, std::vector<cv::Point2f> const& previous_points,
+	std::vector<cv::Point2f>& out_points)
+{
+	cv::Mat frame_small;
+	const float scale = DownscaleForSearch(frame_grey, config.SearchMaxSize, frame_small);
+
+	// Cheap checks before the blob detection: a flat or blurred image can not show the circles
+	cv::Scalar mean, stddev;
+	cv::meanStdDev(frame_small, mean, stddev);
+	if (stddev[0] < config.MinContrast)
+	{
+		return false;
+	}
+
+	cv::Mat laplacian;
+	cv::Laplacian(frame_small, laplacian, CV_16S);
+	cv::meanStdDev(laplacian, mean, stddev);
+	if (stddev[0] * stddev[0] < config.MinSharpness)
+	{
+		return false;
+	}
+
+	bool found = false;
+
+	// The pattern is usually near where it was in the previous frame
+	if (!previous_points.empty())
+	{
+		const cv::Rect previous_rect = cv::boundingRect(previous_points);
+		const int32 margin_x = FMath::CeilToInt(previous_rect.width * PREVIOUS_DETECTION_MARGIN);
+		const int32 margin_y = FMath::CeilToInt(previous_rect.height * PREVIOUS_DETECTION_MARGIN);
+		const cv::Rect region = cv::Rect(previous_rect.x - margin_x, previous_rect.y - margin_y,
+			previous_rect.width + 2 * margin_x, previous_rect.height + 2 * margin_y) & cv::Rect(0, 0, frame_grey.cols, frame_grey.rows);
+
+		// Not worth it if the region is most of the frame
+		if (region.area() > 0 && region.area() < frame_grey.cols * frame_grey.rows / 2)
+		{
+			cv::Mat region_small;
+			const float region_scale = DownscaleForSearch(frame_grey(region), config.SearchMaxSize, region_small);
+			found = FindCirclesScaled(region_small, region_scale, cv::Point2f(region.x, region.y), config.PatternSize, out_points);
+		}
+	}
+
+	if (!found)
+	{
+		found = FindCirclesScaled(frame_small, scale, cv::Point2f(0, 0), config.PatternSize, out_points);
+	}
+
+	if (found)
+	{
+		RefineCentres(frame_grey, out_points);
 	}
 
-	return false;
+	return found;
 }
 
-void FOpenCVCameraCalibrationProcess::CalculateCalibration()
+void FOpenCVCameraCalibrationProcess::RefineCentres(cv::Mat const& frame_grey, std::vector<cv::Point2f>& points)
 {
-	// Calculate points in the pattern
-	// OpenCV does not write to the vector, so it can be created/deleted here
-	std::vector< std::vector< cv::Point3f > > object_points(1);
-	for (int8 col = 0; col < PatternSize.height; col++)
+	// Consecutive points of a row are neighbours, the closest pair gives the spacing of the circles
+	float spacing = TNumericLimits<float>::Max();
+	for (size_t idx = 1; idx < points.size(); idx++)
+	{
+		spacing = FMath::Min(spacing, float(cv::norm(points[idx] - points[idx - 1])));
+	}
+
+	if (spacing == TNumericLimits<float>::Max())
 	{
-		for (int8 row = 0; row < PatternSize.width; row++)
+		return;
+	}
+
+	const int32 radius = FMath::Max(2, FMath::FloorToInt(spacing * CENTROID_WINDOW_RATIO));
+	const cv::Rect frame_rect(0, 0, frame_grey.cols, frame_grey.rows);
+
+	for (cv::Point2f& pt : points)
+	{
+		const cv::Rect window = cv::Rect(cvRound(pt.x) - radius, cvRound(pt.y) - radius, 2 * radius + 1, 2 * radius + 1) & frame_rect;
+		if (window.area() == 0)
 		{
-			object_points[0].push_back(cv::Point3f(
-				SquareSize * float(2 * row + col % 2),
-				SquareSize * float(col),
-				0));
+			continue;
+		}
+
+		const cv::Mat patch = frame_grey(window);
+
+		double brightness_min, brightness_max;
+		cv::minMaxLoc(patch, &brightness_min, &brightness_max);
+		if (brightness_max - brightness_min < 1.0)
+		{
+			continue;
+		}
+
+		// The circles are dark on white paper, pixels are weighted by how much darker than the midpoint they are
+		const double threshold = 0.5 * (brightness_min + brightness_max);
+		double sum_weight = 0, sum_x = 0, sum_y = 0;
+
+		for (int32 row = 0; row < patch.rows; row++)
+		{
+			const uint8* row_ptr = patch.ptr<uint8>(row);
+			for (int32 col = 0; col < patch.cols; col++)
+			{
+				const double weight = threshold - row_ptr[col];
+				if (weight > 0)
+				{
+					sum_weight += weight;
+					sum_x += weight * col;
+					sum_y += weight * row;
+				}
+			}
+		}
+
+		if (sum_weight > 0)
+		{
+			pt = cv::Point2f(window.x + sum_x / sum_weight, window.y + sum_y / sum_weight);
+		}
+	}
+}
+
+void FOpenCVCameraCalibrationProcess::Solve(FStateRef const& state, FConfig const& config, int32 generation, FViews const& views, bool final)
+{
+	// New matrices, so copies of the previous result are not modified
+	FOpenCVCameraProperties properties;
+	double focal_uncertainty = -1.0;
+	const double calibration_error = CalculateCalibration(config, views, properties, focal_uncertainty);
+
+	// More views would not change the intrinsics noticeably
+	const bool converged = calibration_error >= 0 && focal_uncertainty >= 0 && focal_uncertainty < config.MaxFocalUncertainty
+		&& int32(views.PointSets.size()) >= config.MinFramesToStop;
+
+	FScopeLock lock(&state->Lock);
+
+	if (!final)
+	{
+		state->bIncrementalSolving = false;
+	}
+
+	// Reset was called, or another solve already finished the calibration
+	if (state->Generation != generation || state->bFinished)
+	{
+		return;
+	}
+
+	state->CalibrationError = calibration_error;
+	state->FocalUncertainty = focal_uncertainty;
+
+	if (final || converged)
+	{
+		// Also when the solve failed, so that the calibration ends instead of waiting forever
+		state->bFinalSolveStarted = true;
+		state->bFinished = true;
+
+		if (calibration_error < 0)
+		{
+			UE_LOG(LogAUR, Error, TEXT("FOpenCVCameraCalibrationProcess: Calibration with %d views failed"), int32(views.PointSets.size()))
+
+			// The properties hold the identity matrix set before the solve, they must not replace the current calibration
+			state->bFailed = true;
 		}
+		else
+		{
+			UE_LOG(LogAUR, Log, TEXT("FOpenCVCameraCalibrationProcess: Calibration finished with %d views, error: %lf, focal uncertainty: %.2f%%"),
+				int32(views.PointSets.size()), calibration_error, focal_uncertainty * 100.0)
+			properties.PrintToLog();
+
+			state->CameraProperties = properties;
+		}
+	}
+	else
+	{
+		UE_LOG(LogAUR, Log, TEXT("FOpenCVCameraCalibrationProcess: Error with %d frames: %lf, focal uncertainty: %.2f%%"),
+			int32(views.PointSets.size()), calibration_error, focal_uncertainty * 100.0)
 	}
-	object_points.resize(DetectedPointSets.size(), object_points[0]);
+}
+
+void FOpenCVCameraCalibrationProcess::GetLastDetectedPoints(std::vector<cv::Point2f>& out_points) const
+{
+	FScopeLock lock(&State->Lock);
+	out_points = State->LastDetectedPoints;
+}
+
+bool FOpenCVCameraCalibrationProcess::IsFinished() const
+{
+	FScopeLock lock(&State->Lock);
+	return State->bFinished;
+}
+
+bool FOpenCVCameraCalibrationProcess::HasFailed() const
+{
+	FScopeLock lock(&State->Lock);
+	return State->bFailed;
+}
+
+bool FOpenCVCameraCalibrationProcess::IsSolving() const
+{
+	FScopeLock lock(&State->Lock);
+	return State->bFinalSolveStarted && !State->bFinished;
+}
+
+float FOpenCVCameraCalibrationProcess::GetProgress() const
+{
+	FScopeLock lock(&State->Lock);
+	if (State->bFinished)
+	{
+		return 1.0;
+	}
+	return float(State->FramesCollected) / float(Config.FramesNeeded + 1);
+}
+
+double FOpenCVCameraCalibrationProcess::GetCalibrationError() const
+{
+	FScopeLock lock(&State->Lock);
+	return State->CalibrationError;
+}
+
+double FOpenCVCameraCalibrationProcess::GetFocalUncertainty() const
+{
+	FScopeLock lock(&State->Lock);
+	return State->FocalUncertainty;
+}
 
-	// OpenCV writes directoy to those vectors, so they need to be allocated/deleted outside AUR binary
-	//CvWrapper< std::vector<cv::Mat> > r_vecs, t_vecs;
+FOpenCVCameraProperties FOpenCVCameraCalibrationProcess::GetCameraProperties() const
+{
+	FScopeLock lock(&State->Lock);
+	return State->CameraProperties;
+}
 
-	//std::vector<cv::Mat> r_vecs, t_vecs;
+double FOpenCVCameraCalibrationProcess::CalculateCalibration(FConfig const& config, FViews const& views, FOpenCVCameraProperties& out_properties,
+	double& out_focal_uncertainty)
+{
+	out_properties.SetResolution(views.Resolution);
+	const cv::Size image_size(views.Resolution.X, views.Resolution.Y);
+
+	double calibration_error = -1.0;
+	out_focal_uncertainty = -1.0;
 
 #if !PLATFORM_ANDROID
 	try
 	{
 #endif
-		cv::setIdentity(CameraProperties.CameraMatrix);
-		CameraProperties.DistortionCoefficients.setTo(0.0);
+		cv::setIdentity(out_properties.CameraMatrix);
+		out_properties.DistortionCoefficients.setTo(0.0);
 
-		// the error is root-square-mean
-		double calibration_error = cv::calibrateCamera(object_points, DetectedPointSets, cv::Size(CameraProperties.Resolution.X, CameraProperties.Resolution.Y),
-			CameraProperties.CameraMatrix, CameraProperties.DistortionCoefficients, cv::noArray(), cv::noArray(),
-			CalibrationFlags);
+		// Standard deviations of fx, fy, cx, cy, k1, ...
+		cv::Mat_<double> std_intrinsics;
 
-		UE_LOG(LogAUR, Log, TEXT("FOpenCVCameraCalibrationProcess: Calibration finished, error: %lf"), calibration_error)
+		if (views.CharucoBoard)
+		{
+			// The board knows the positions of the corners by their IDs
+			calibration_error = cv::aruco::calibrateCameraCharuco(views.PointSets, views.IdSets, views.CharucoBoard, image_size,
+				out_properties.CameraMatrix, out_properties.DistortionCoefficients, cv::noArray(), cv::noArray(),
+				std_intrinsics, cv::noArray(), cv::noArray(), config.CalibrationFlags);
+		}
+		else
+		{
+			// OpenCV does not write to the vector, so it can be created/deleted here
+			std::vector< std::vector< cv::Point3f > > object_points(views.PointSets.size(), GetCirclesObjectPoints(config));
+
+			// the error is root-square-mean
+			calibration_error = cv::calibrateCamera(object_points, views.PointSets, image_size,
+				out_properties.CameraMatrix, out_properties.DistortionCoefficients, cv::noArray(), cv::noArray(),
+				std_intrinsics, cv::noArray(), cv::noArray(), config.CalibrationFlags);
+		}
 
-		CameraProperties.DeriveFOV();
-		CameraProperties.PrintToLog();
+		const double focal = out_properties.CameraMatrix(0, 0);
+		if (!std_intrinsics.empty() && focal > 0)
+		{
+			out_focal_uncertainty = std_intrinsics(0) / focal;
+		}
+
+		out_properties.DeriveFOV();
 #if !PLATFORM_ANDROID
 	}
 	catch (std::exception& exc)
@@ -331,4 +991,6 @@ void FOpenCVCameraCalibrationProcess::CalculateCalibration()
 		UE_LOG(LogAUR, Error, TEXT("CalculateCalibration: exception\n    %s"), UTF8_TO_TCHAR(exc.what()))
 	}
 #endif
+
+	return calibration_error;
 }
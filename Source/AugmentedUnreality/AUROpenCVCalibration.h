@@ -83,8 +83,25 @@ protected:
 	static const char* KEY_DISTORTION;
 };
 
+UENUM(BlueprintType)
+enum class EAURCalibrationPattern : uint8
+{
+	// Printed asymmetric circles grid 4x11, has to be fully visible in each frame
+	CirclesGrid,
+	// ChArUco board registered with the tracker (AURFiducialPatternFlatBoard), partial views are accepted
+	ChArUcoBoard
+};
+
 /*
-	OpenCV camera calibration using the asymmetric circles 4x11 pattern.
+	OpenCV camera calibration using the asymmetric circles 4x11 pattern,
+	or using the chessboard corners of a ChArUco board found by the marker tracker.
+
+	Views are collected only if they are sharp and show the pattern in image areas, tilts or distances
+	not yet covered by enough views, and the calibration stops as soon as the focal length is known precisely enough.
+
+	The pattern search and the solve run on background tasks, so the thread capturing video
+	is never blocked: ProcessFrame only copies the frame, and the results are picked up later.
+	All methods can be called from any thread.
 */
 class FOpenCVCameraCalibrationProcess
 {
@@ -92,47 +109,213 @@ public:
 	FOpenCVCameraCalibrationProcess();
 
 	// Prepare for a new calibration, clear any the process if it is in progress.
+	// Tasks already running finish in the background, their results are discarded.
 	void Reset();
 
-	// Try using a new frame. Time is given so that there is appropriate interval
-	// between consecutive captured frames.
-	bool ProcessFrame(cv::Mat& frame, float time_now);
+	/*
+		Offer a new frame for the pattern search, returns immediately.
+		Time is given so that there is appropriate interval between consecutive captured frames.
+		The frame is skipped while the previous one is still searched.
+		Returns true if the frame was taken for the search.
+	*/
+	bool ProcessFrame(cv::Mat const& frame, float time_now);
 
-	bool IsFinished() const
-	{
-		return FramesCollected == FramesNeeded;
-	}
+	/*
+		Offer the chessboard corners of a ChArUco board found by the tracker in a frame, returns immediately.
+		Partial views of the board are accepted, if they have at least MinCharucoCorners corners.
+		Views of the circles pattern or another board collected before are discarded.
+		Returns true if the view was collected.
+	*/
+	bool ProcessCharucoCorners(cv::Mat const& frame, std::vector<cv::Point2f> const& corners, std::vector<int> const& ids,
+		cv::Ptr<cv::aruco::CharucoBoard> const& board, float time_now);
+
+	// Pattern points found in the last frame which was searched, empty if the pattern was not found
+	void GetLastDetectedPoints(std::vector<cv::Point2f>& out_points) const;
+
+	// The final solve has finished, GetCameraProperties holds the result unless HasFailed
+	bool IsFinished() const;
 
-	float GetProgress() const
+	// The final solve has finished but OpenCV could not calibrate, GetCameraProperties is not a result
+	bool HasFailed() const;
+
+	// Enough frames were collected and the final solve is running
+	bool IsSolving() const;
+
+	// The final solve counts as the last step, so the progress reaches 1 only when it finishes
+	float GetProgress() const;
+
+	// RMS reprojection error (pixels) of the latest solve, incremental or final, negative before the first one
+	double GetCalibrationError() const;
+
+	// Standard deviation of the focal length estimated by the latest solve, relative to the focal length, negative before the first one
+	double GetFocalUncertainty() const;
+
+	FOpenCVCameraProperties GetCameraProperties() const;
+
+protected:
+	struct FConfig
 	{
-		return float(FramesCollected) / float(FramesNeeded);
-	}
+		// Most frames captured before calibration is calculated, fewer if it converges earlier.
+		int32 FramesNeeded;
+
+		// Time between capturing consecutive frames
+		float MinInterval;
+
+		// Number of rows / columns in the pattern.
+		cv::Size PatternSize;
 
-	FOpenCVCameraProperties const& GetCameraProperties() const
+		// Distance between rows/columns
+		float SquareSize;
+
+		int32 CalibrationFlags;
+
+		// Solve with the frames collected so far after every N frames, for a live error estimate. 0 to disable.
+		int32 IncrementalSolveInterval;
+
+		// The pattern is searched in images downscaled so that the longer side is at most this (pixels), then refined at full resolution
+		int32 SearchMaxSize;
+
+		// Frames with a lower standard deviation of brightness (0-255) can not show the pattern and are not searched
+		float MinContrast;
+
+		// Frames with a lower variance of the Laplacian of the downscaled image are too blurred and are not searched
+		float MinSharpness;
+
+		// ChArUco views with fewer corners are not collected
+		int32 MinCharucoCorners;
+
+		// Views with a lower variance of the Laplacian around the pattern, at full resolution, are too blurred to collect
+		float MinPatternSharpness;
+
+		/*
+			The image is divided into CoverageGridSize x CoverageGridSize cells.
+			A view is collected only if it shows the pattern in a cell, tilt or distance range seen in fewer than CoverageTarget views.
+		*/
+		int32 CoverageGridSize;
+		int32 CoverageTarget;
+
+		// If no view added coverage for this long (seconds), views are collected regardless, so the calibration can not stall
+		float CoverageStallTime;
+
+		// The calibration stops once the focal length's standard deviation relative to it is below this,
+		// with at least MinFramesToStop views
+		float MaxFocalUncertainty;
+		int32 MinFramesToStop;
+	};
+
+	// What a view adds to the coverage of the calibration
+	struct FViewCoverage
+	{
+		// Cells of the coverage grid containing points of the pattern
+		TArray<int32> Cells;
+		int32 TiltBin;
+		int32 DistanceBin;
+		// Variance of the Laplacian around the pattern
+		float Sharpness;
+
+		FViewCoverage()
+			: TiltBin(0)
+			, DistanceBin(0)
+			, Sharpness(0)
+		{
+		}
+	};
+
+	// Views to calibrate from
+	struct FViews
 	{
-		return CameraProperties;
-	}
+		std::vector<cv::Mat> PointSets;
+		// Corner IDs of each view, only for ChArUco
+		std::vector<cv::Mat> IdSets;
+		// Set if the views are of a ChArUco board, otherwise of the circles pattern
+		cv::Ptr<cv::aruco::CharucoBoard> CharucoBoard;
+		FIntPoint Resolution;
+	};
+
+	// Shared with the background tasks, which may outlive this object
+	struct FState
+	{
+		mutable FCriticalSection Lock;
+
+		// Increased by Reset, results of tasks started before are discarded
+		int32 Generation;
+
+		std::vector<cv::Mat> DetectedPointSets;
+		std::vector<cv::Mat> DetectedIdSets;
+		cv::Ptr<cv::aruco::CharucoBoard> CharucoBoard;
+		std::vector<cv::Point2f> LastDetectedPoints;
+		int32 FramesCollected;
+		float LastFrameTime;
+		FIntPoint Resolution;
+
+		// Copy of the frame being searched, owned by the search task while bSearching
+		cv::Mat SearchFrame;
+		bool bSearching;
+		bool bIncrementalSolving;
+		bool bFinalSolveStarted;
+		bool bFinished;
+		bool bFailed;
+
+		// Numbers of collected views in each cell of the grid, tilt and distance bin
+		TArray<int32> CellCounts;
+		TArray<int32> TiltCounts;
+		TArray<int32> DistanceCounts;
+		float LastCoverageGainTime;
+
+		double CalibrationError;
+		double FocalUncertainty;
+		FOpenCVCameraProperties CameraProperties;
+
+		FState();
+	};
+
+	typedef TSharedRef<FState, ESPMode::ThreadSafe> FStateRef;
+
+	FConfig Config;
+	FStateRef State;
+
+	// Background task: look for the pattern in State->SearchFrame
+	static void SearchFrame(FStateRef const& state, FConfig const& config, int32 generation, float time_now);
+
+	/*
+		Look for the pattern in a grey frame: first around the previous detection, then in the whole frame,
+		each time in a downscaled image. Rejects low contrast and blurred frames early.
+	*/
+	static bool FindPattern(cv::Mat const& frame_grey, FConfig const& config, std::vector<cv::Point2f> const& previous_points,
+		std::vector<cv::Point2f>& out_points);
 
-protected:
-	// Number of frames to be captured before calibration is calculated.
-	int32 FramesNeeded;
+	// Move the centres found in a downscaled image to the centroids of the dark blobs in the full resolution frame
+	static void RefineCentres(cv::Mat const& frame_grey, std::vector<cv::Point2f>& points);
+
+	// Positions of the circles on the pattern, in the units of SquareSize
+	static std::vector<cv::Point3f> GetCirclesObjectPoints(FConfig const& config);
 
-	// Time between capturing consecutive frames
-	float MinInterval;
+	/*
+		Measure which grid cells the image points cover, and estimate the tilt and distance of the pattern
+		from the homography between the pattern's plane (object_points) and the image.
+	*/
+	static void MeasureCoverage(FConfig const& config, std::vector<cv::Point2f> const& image_points, std::vector<cv::Point3f> const& object_points,
+		cv::Mat const& frame, FViewCoverage& out_coverage);
 
-	// Number of rows / columns in the pattern.
-	cv::Size PatternSize;
+	// Number of cells and bins of the view which are covered by fewer than CoverageTarget collected views
+	static int32 CountCoverageGain(FState const& state, FConfig const& config, FViewCoverage const& coverage);
 
-	// Distance between rows/columns
-	float SquareSize;
+	// Whether the view is worth collecting, with the state's lock held
+	static bool ShouldCollectView(FState const& state, FConfig const& config, FViewCoverage const& coverage, float time_now);
 
-	int32 CalibrationFlags;
+	// Count the view just appended to the state's point sets and start a solve if it is time, with the state's lock held
+	static void AddView(FStateRef const& state, FConfig const& config, int32 generation, FViewCoverage const& coverage, float time_now);
 
-	std::vector<cv::Mat> DetectedPointSets;
-	int32 FramesCollected;
-	float LastFrameTime;
+	// Drop the collected views, with the state's lock held
+	static void ClearViews(FState& state);
 
-	FOpenCVCameraProperties CameraProperties;
+	// Background task: calibrate from the given views, the final solve also stores the camera properties
+	static void Solve(FStateRef const& state, FConfig const& config, int32 generation, FViews const& views, bool final);
 
-	void CalculateCalibration();
+	/*
+		Calibrate the camera, returns the RMS reprojection error or a negative value if OpenCV failed.
+		out_focal_uncertainty: standard deviation of the focal length relative to it
+	*/
+	static double CalculateCalibration(FConfig const& config, FViews const& views, FOpenCVCameraProperties& out_properties,
+		double& out_focal_uncertainty);
 };
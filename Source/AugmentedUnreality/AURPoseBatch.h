@@ -0,0 +1,122 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AURPoseBatch.generated.h"
+
+class AAURFiducialPattern;
+
+/*
+	Poses of all boards updated in one tick, as parallel arrays: element i of each array describes the same board.
+	Delivered at once by UAURDriver::OnPoseBatchUpdate instead of one event per board.
+*/
+USTRUCT(BlueprintType)
+struct FAURPoseBatch
+{
+	GENERATED_BODY()
+
+	// Tracked boards are identified by the lowest ID of their markers
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<int32> BoardIds;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = AugmentedReality)
+	TArray<AAURFiducialPattern*> Boards;
+
+	// Board transforms relative to the viewpoint, as passed to AAURFiducialPattern::TransformMeasured
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<FTransform> Transforms;
+
+	// Fraction of the board's markers seen in the frame, 0 for poses predicted from motion
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	TArray<float> Qualities;
+
+	// Time of the frame in which each pose was measured (FPlatformTime::Seconds() or the simulated clock)
+	TArray<double> Timestamps;
+
+	int32 Num() const
+	{
+		return BoardIds.Num();
+	}
+
+	void Reset()
+	{
+		BoardIds.Reset();
+		Boards.Reset();
+		Transforms.Reset();
+		Qualities.Reset();
+		Timestamps.Reset();
+	}
+
+	void Add(int32 board_id, AAURFiducialPattern* board, FTransform const& transform, float quality, double timestamp)
+	{
+		BoardIds.Add(board_id);
+		Boards.Add(board);
+		Transforms.Add(transform);
+		Qualities.Add(quality);
+		Timestamps.Add(timestamp);
+	}
+};
+
+// Poses solved for one frame, given to IAURPoseListener on the detection thread
+struct FAURPoseFrame
+{
+	// Increases by one with each frame processed by the tracker
+	int64 FrameId;
+
+	// Time of the frame (FPlatformTime::Seconds() or the simulated clock)
+	double Timestamp;
+
+	// The poses were extrapolated from motion, detection did not run on this frame
+	bool bPredicted;
+
+	// Camera transform, valid if the viewpoint was measured or predicted in this frame
+	bool bViewpointUpdated;
+	FTransform ViewpointTransform;
+
+	// Board poses relative to the viewpoint. Shared by all listeners and never modified, so it can be kept after the call.
+	TSharedRef<const FAURPoseBatch, ESPMode::ThreadSafe> Poses;
+
+	FAURPoseFrame(TSharedRef<const FAURPoseBatch, ESPMode::ThreadSafe> const& poses)
+		: FrameId(0)
+		, Timestamp(0)
+		, bPredicted(false)
+		, bViewpointUpdated(false)
+		, ViewpointTransform(FTransform::Identity)
+		, Poses(poses)
+	{
+	}
+};
+
+/*
+	Receives poses as soon as they are solved, registered with UAURDriverOpenCV::AddPoseListener.
+	Unlike OnPoseBatchUpdate, which waits for the game thread's tick, it is called on the detection thread.
+*/
+class IAURPoseListener
+{
+public:
+	virtual ~IAURPoseListener() {}
+
+	/*
+		Called on the detection thread right after the poses of a frame are solved.
+		Detection of the next frame waits for it, so it should return quickly.
+		The board actors in the batch belong to the game thread and must not be used here.
+	*/
+	virtual void OnPosesSolved(FAURPoseFrame const& frame) = 0;
+};
+
+typedef TSharedRef<IAURPoseListener, ESPMode::ThreadSafe> FAURPoseListenerRef;
@@ -0,0 +1,112 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURThreading.h"
+#include "AURLog.h"
+#include "AUROpenCV.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+
+FThreadSafeBool FAURThreading::bUseEngineThreadPool(false);
+FThreadSafeCounter FAURThreading::MaxParallelThreads(0);
+
+EThreadPriority FAURThreading::GetThreadPriority(EAURThreadPriority priority)
+{
+	switch (priority)
+	{
+	case EAURThreadPriority::AURTP_Lowest:
+		return TPri_Lowest;
+	case EAURThreadPriority::AURTP_BelowNormal:
+		return TPri_BelowNormal;
+	case EAURThreadPriority::AURTP_AboveNormal:
+		return TPri_AboveNormal;
+	case EAURThreadPriority::AURTP_Highest:
+		return TPri_Highest;
+	default:
+		return TPri_Normal;
+	}
+}
+
+uint64 FAURThreading::GetAffinityMask(TArray<int32> const& cores)
+{
+	uint64 mask = 0;
+
+	for (int32 core : cores)
+	{
+		if (core >= 0 && core < 64)
+		{
+			mask |= uint64(1) << core;
+		}
+		else
+		{
+			UE_LOG(LogAUR, Warning, TEXT("FAURThreading::GetAffinityMask: Core index %d out of range"), core)
+		}
+	}
+
+	return mask ? mask : FPlatformAffinity::GetNoAffinityMask();
+}
+
+FRunnableThread* FAURThreading::CreateWorkerThread(FRunnable* runnable, FString const& thread_name, FAURThreadingSettings const& settings)
+{
+	return FRunnableThread::Create(runnable, *thread_name, 0,
+		GetThreadPriority(settings.WorkerPriority), GetAffinityMask(settings.WorkerCores));
+}
+
+void FAURThreading::ApplyParallelSettings(FAURThreadingSettings const& settings)
+{
+	bUseEngineThreadPool.AtomicSet(settings.bUseEngineThreadPool);
+	MaxParallelThreads.Set(FMath::Max(0, settings.MaxParallelThreads));
+
+	if (settings.bUseEngineThreadPool)
+	{
+		// Sequential execution inside OpenCV, parallelism comes from the engine
+		cv::setNumThreads(0);
+	}
+	else
+	{
+		// Negative restores OpenCV's default
+		cv::setNumThreads(settings.MaxParallelThreads > 0 ? settings.MaxParallelThreads : -1);
+	}
+}
+
+void FAURThreading::ParallelFor(int32 num, TFunctionRef<void(int32 begin, int32 end)> body)
+{
+	if (num <= 0)
+	{
+		return;
+	}
+
+	if (bUseEngineThreadPool)
+	{
+		int32 num_chunks = MaxParallelThreads.GetValue();
+		if (num_chunks <= 0)
+		{
+			// The calling thread also takes part
+			num_chunks = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+		}
+		num_chunks = FMath::Clamp(num_chunks, 1, num);
+
+		::ParallelFor(num_chunks, [&](int32 chunk) {
+			body(int32((int64(chunk) * num) / num_chunks), int32((int64(chunk + 1) * num) / num_chunks));
+		});
+	}
+	else
+	{
+		cv::parallel_for_(cv::Range(0, num), [&](cv::Range const& range) {
+			body(range.start, range.end);
+		});
+	}
+}
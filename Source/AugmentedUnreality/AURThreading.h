@@ -0,0 +1,98 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "AURThreading.generated.h"
+
+UENUM(BlueprintType)
+enum class EAURThreadPriority : uint8
+{
+	AURTP_Lowest = 0		UMETA(DisplayName = "Lowest"),
+	AURTP_BelowNormal = 1	UMETA(DisplayName = "Below normal"),
+	AURTP_Normal = 2		UMETA(DisplayName = "Normal"),
+	AURTP_AboveNormal = 3	UMETA(DisplayName = "Above normal"),
+	AURTP_Highest = 4		UMETA(DisplayName = "Highest")
+};
+
+USTRUCT(BlueprintType)
+struct FAURThreadingSettings
+{
+	GENERATED_BODY()
+
+	// Priority of the capture and tracking threads
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	EAURThreadPriority WorkerPriority;
+
+	// Cores on which the capture and tracking threads may run, empty means any core
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	TArray<int32> WorkerCores;
+
+	// Run the frame processing stages as task graph tasks. Otherwise they run one after another on the capture thread.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bRunStagesOnTaskGraph;
+
+	/*
+		Run the plugin's parallel loops on the engine's task graph and disable OpenCV's own thread pool,
+		so that image processing does not compete with the game and render threads for cores.
+		OpenCV functions then run single-threaded on the calling thread.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bUseEngineThreadPool;
+
+	// Maximal number of threads used by one parallel loop, 0 means the number of worker threads of the engine / OpenCV's default
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0", UIMin = "0"))
+	int32 MaxParallelThreads;
+
+	FAURThreadingSettings()
+		: WorkerPriority(EAURThreadPriority::AURTP_Normal)
+		, bRunStagesOnTaskGraph(true)
+		, bUseEngineThreadPool(false)
+		, MaxParallelThreads(0)
+	{
+	}
+};
+
+class FAURThreading
+{
+public:
+	static EThreadPriority GetThreadPriority(EAURThreadPriority priority);
+
+	// Affinity mask for FRunnableThread::Create
+	static uint64 GetAffinityMask(TArray<int32> const& cores);
+
+	static FRunnableThread* CreateWorkerThread(FRunnable* runnable, FString const& thread_name, FAURThreadingSettings const& settings);
+
+	/*
+		Configure the parallel loops for the whole process.
+		OpenCV 4.4 chooses its parallel backend at compile time, so its loops can not be forwarded to the engine;
+		instead its pool is limited or disabled with cv::setNumThreads.
+	*/
+	static void ApplyParallelSettings(FAURThreadingSettings const& settings);
+
+	/*
+		Split [0, num) into ranges and run body on them in parallel,
+		through the engine's task graph or OpenCV's pool depending on ApplyParallelSettings.
+	*/
+	static void ParallelFor(int32 num, TFunctionRef<void(int32 begin, int32 end)> body);
+
+protected:
+	static FThreadSafeBool bUseEngineThreadPool;
+	static FThreadSafeCounter MaxParallelThreads;
+};
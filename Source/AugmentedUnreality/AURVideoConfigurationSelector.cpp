@@ -0,0 +1,348 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURVideoConfigurationSelector.h"
+#include "AURLog.h"
+
+// Measured FPS is allowed to be slightly below the target, cameras rarely deliver the exact nominal rate
+static const double FPS_TOLERANCE = 0.95;
+// Weight of the newest frame in the running averages used for runtime adaptation
+static const double AVERAGE_WEIGHT = 0.1;
+
+void FAURVideoConfigurationSelector::FMeasurement::Add(double time_now, double capture_time, double processing_time)
+{
+	if (FrameCount == 0)
+	{
+		FirstFrameTime = time_now;
+	}
+	LastFrameTime = time_now;
+
+	FrameCount += 1;
+	CaptureTimeSum += capture_time;
+	ProcessingTimeSum += processing_time;
+}
+
+double FAURVideoConfigurationSelector::FMeasurement::GetFPS() const
+{
+	if (FrameCount > 1 && LastFrameTime > FirstFrameTime)
+	{
+		return double(FrameCount - 1) / (LastFrameTime - FirstFrameTime);
+	}
+	return 0.0;
+}
+
+double FAURVideoConfigurationSelector::FMeasurement::GetAverageProcessingTime() const
+{
+	return FrameCount > 0 ? ProcessingTimeSum / FrameCount : 0.0;
+}
+
+FAURVideoConfigurationSelector::FAURVideoConfigurationSelector()
+	: State(EState::Idle)
+	, CurrentIndex(0)
+	, HighestAllowedIndex(0)
+	, ConfigurationStartTime(0)
+	, bWaitingForConnection(false)
+	, ReportedState(EState::Idle)
+	, ReportedIndex(0)
+	, ReportedTime(-1.0)
+{
+	ResetRuntimeStatistics();
+}
+
+void FAURVideoConfigurationSelector::Reset()
+{
+	State = EState::Idle;
+	Ladder.Empty();
+	ProbeResults.Empty();
+	CurrentIndex = 0;
+	HighestAllowedIndex = 0;
+	bWaitingForConnection = false;
+	Current.Reset();
+	ResetRuntimeStatistics();
+
+	// The ladder changed, so the same index may be another configuration
+	ReportedTime = -1.0;
+}
+
+void FAURVideoConfigurationSelector::ResetRuntimeStatistics()
+{
+	ProcessingTimeAverage = -1.0;
+	FrameIntervalAverage = -1.0;
+	OverBudgetSince = -1.0;
+	UnderBudgetSince = -1.0;
+}
+
+bool FAURVideoConfigurationSelector::Begin(FAURVideoConfiguration const& opened_configuration, FAURVideoConfiguration& out_first_probe)
+{
+	Reset();
+
+	if (!(Settings.bProbeOnOpen || Settings.bAdaptAtRuntime) || !opened_configuration.VideoSourceObject)
+	{
+		return false;
+	}
+
+	// Only configurations with a known resolution can be compared
+	for (auto const& cfg : opened_configuration.VideoSourceObject->Configurations)
+	{
+		if (cfg.Resolution.GetMin() > 0)
+		{
+			Ladder.Add(cfg);
+		}
+	}
+
+	Ladder.Sort([](FAURVideoConfiguration const& a, FAURVideoConfiguration const& b) {
+		return a.Resolution.X * a.Resolution.Y > b.Resolution.X * b.Resolution.Y;
+	});
+
+	CurrentIndex = Ladder.IndexOfByPredicate([&](FAURVideoConfiguration const& cfg) {
+		return cfg.Identifier == opened_configuration.Identifier;
+	});
+
+	if (Ladder.Num() < 2 || CurrentIndex == INDEX_NONE)
+	{
+		Reset();
+		return false;
+	}
+
+	bWaitingForConnection = true;
+
+	if (Settings.bProbeOnOpen)
+	{
+		UE_LOG(LogAUR, Log, TEXT("FAURVideoConfigurationSelector: Probing %d configurations of %s"),
+			Ladder.Num(), *opened_configuration.VideoSourceObject->GetIdentifier());
+
+		State = EState::Probing;
+		ProbeResults.SetNum(Ladder.Num());
+		CurrentIndex = 0;
+		out_first_probe = Ladder[CurrentIndex];
+		return true;
+	}
+
+	State = EState::Monitoring;
+	return false;
+}
+
+void FAURVideoConfigurationSelector::OnConfigurationOpened(double time_now)
+{
+	ConfigurationStartTime = time_now;
+	bWaitingForConnection = false;
+	Current.Reset();
+	ResetRuntimeStatistics();
+}
+
+bool FAURVideoConfigurationSelector::MeetsTarget(double fps, double processing_time) const
+{
+	return fps >= Settings.TargetFPS * FPS_TOLERANCE && processing_time * 1000.0 <= Settings.LatencyBudgetMs;
+}
+
+double FAURVideoConfigurationSelector::GetPixelRatio(int32 index_to, int32 index_from) const
+{
+	FIntPoint const& res_to = Ladder[index_to].Resolution;
+	FIntPoint const& res_from = Ladder[index_from].Resolution;
+	return double(res_to.X * res_to.Y) / double(FMath::Max(1, res_from.X * res_from.Y));
+}
+
+bool FAURVideoConfigurationSelector::SwitchTo(int32 ladder_index, FAURVideoConfiguration& out_next)
+{
+	CurrentIndex = ladder_index;
+	out_next = Ladder[CurrentIndex];
+	bWaitingForConnection = true;
+	Current.Reset();
+	ResetRuntimeStatistics();
+	return true;
+}
+
+bool FAURVideoConfigurationSelector::AddFrameMeasurement(double time_now, double capture_time, double processing_time, FAURVideoConfiguration& out_next)
+{
+	if (State == EState::Idle || !IsWarm(time_now))
+	{
+		return false;
+	}
+
+	const double previous_frame_time = Current.LastFrameTime;
+	const bool has_previous_frame = Current.FrameCount > 0;
+	Current.Add(time_now, capture_time, processing_time);
+
+	if (State == EState::Probing)
+	{
+		if (time_now >= ConfigurationStartTime + Settings.WarmupDuration + Settings.ProbeDuration)
+		{
+			return FinishProbeStep(out_next);
+		}
+		return false;
+	}
+
+	// Monitoring - update the running averages
+	ProcessingTimeAverage = ProcessingTimeAverage < 0 ? processing_time
+		: FMath::Lerp(ProcessingTimeAverage, processing_time, AVERAGE_WEIGHT);
+
+	if (!has_previous_frame)
+	{
+		return false;
+	}
+
+	const double frame_interval = time_now - previous_frame_time;
+	FrameIntervalAverage = FrameIntervalAverage < 0 ? frame_interval
+		: FMath::Lerp(FrameIntervalAverage, frame_interval, AVERAGE_WEIGHT);
+
+	const double fps = FrameIntervalAverage > 0 ? 1.0 / FrameIntervalAverage : 0.0;
+
+	if (!MeetsTarget(fps, ProcessingTimeAverage))
+	{
+		UnderBudgetSince = -1.0;
+
+		if (OverBudgetSince < 0)
+		{
+			OverBudgetSince = time_now;
+		}
+		else if (time_now - OverBudgetSince >= Settings.DowngradeDelay && CurrentIndex + 1 < Ladder.Num())
+		{
+			UE_LOG(LogAUR, Log, TEXT("FAURVideoConfigurationSelector: Over budget (%.1f fps, %.1f ms), switching down to %s"),
+				fps, ProcessingTimeAverage * 1000.0, *Ladder[CurrentIndex + 1].Identifier);
+
+			// If the camera itself is too slow at this resolution, do not try it again
+			if (fps < Settings.TargetFPS * FPS_TOLERANCE)
+			{
+				HighestAllowedIndex = FMath::Max(HighestAllowedIndex, CurrentIndex + 1);
+			}
+
+			return SwitchTo(CurrentIndex + 1, out_next);
+		}
+		return false;
+	}
+
+	OverBudgetSince = -1.0;
+
+	if (CurrentIndex > HighestAllowedIndex)
+	{
+		// Processing time scales roughly with the number of pixels
+		const double estimated_time = ProcessingTimeAverage * GetPixelRatio(CurrentIndex - 1, CurrentIndex);
+
+		if (estimated_time * 1000.0 < Settings.LatencyBudgetMs * Settings.UpgradeMargin)
+		{
+			if (UnderBudgetSince < 0)
+			{
+				UnderBudgetSince = time_now;
+			}
+			else if (time_now - UnderBudgetSince >= Settings.UpgradeDelay)
+			{
+				UE_LOG(LogAUR, Log, TEXT("FAURVideoConfigurationSelector: Under budget (estimated %.1f ms), switching up to %s"),
+					estimated_time * 1000.0, *Ladder[CurrentIndex - 1].Identifier);
+
+				return SwitchTo(CurrentIndex - 1, out_next);
+			}
+		}
+		else
+		{
+			UnderBudgetSince = -1.0;
+		}
+	}
+
+	return false;
+}
+
+bool FAURVideoConfigurationSelector::Update(double time_now, FAURVideoConfiguration& out_next)
+{
+	// A configuration which does not deliver enough frames still has to finish probing
+	if (State == EState::Probing && !bWaitingForConnection
+		&& time_now >= ConfigurationStartTime + Settings.WarmupDuration + 2.0 * Settings.ProbeDuration)
+	{
+		return FinishProbeStep(out_next);
+	}
+
+	return false;
+}
+
+bool FAURVideoConfigurationSelector::FinishProbeStep(FAURVideoConfiguration& out_next)
+{
+	ProbeResults[CurrentIndex] = Current;
+
+	UE_LOG(LogAUR, Log, TEXT("FAURVideoConfigurationSelector: Probe %s: %.1f fps, processing %.1f ms"),
+		*Ladder[CurrentIndex].Identifier, Current.GetFPS(), Current.GetAverageProcessingTime() * 1000.0);
+
+	if (CurrentIndex + 1 < Ladder.Num())
+	{
+		return SwitchTo(CurrentIndex + 1, out_next);
+	}
+
+	// All candidates measured - choose the highest resolution which meets the target
+	int32 best_index = ProbeResults.IndexOfByPredicate([this](FMeasurement const& result) {
+		return result.FrameCount > 0 && MeetsTarget(result.GetFPS(), result.GetAverageProcessingTime());
+	});
+
+	// If none does, take the fastest one
+	if (best_index == INDEX_NONE)
+	{
+		best_index = Ladder.Num() - 1;
+		for (int32 idx = 0; idx < ProbeResults.Num(); idx++)
+		{
+			if (ProbeResults[idx].GetFPS() > ProbeResults[best_index].GetFPS())
+			{
+				best_index = idx;
+			}
+		}
+
+		UE_LOG(LogAUR, Warning, TEXT("FAURVideoConfigurationSelector: No configuration meets %.1f fps / %.1f ms, using the fastest one"),
+			Settings.TargetFPS, Settings.LatencyBudgetMs);
+	}
+
+	UE_LOG(LogAUR, Log, TEXT("FAURVideoConfigurationSelector: Chosen %s"), *Ladder[best_index].Identifier);
+
+	// Higher resolutions were measured as too slow
+	HighestAllowedIndex = best_index;
+	State = Settings.bAdaptAtRuntime ? EState::Monitoring : EState::Idle;
+
+	if (best_index == CurrentIndex)
+	{
+		Current.Reset();
+		ResetRuntimeStatistics();
+		return false;
+	}
+
+	return SwitchTo(best_index, out_next);
+}
+
+bool FAURVideoConfigurationSelector::GetStatusTextIfChanged(double time_now, double min_interval, FString& out_text)
+{
+	// Only the monitoring text shows statistics which change without a change of state
+	const bool changed = ReportedTime < 0 || State != ReportedState || CurrentIndex != ReportedIndex
+		|| (State == EState::Monitoring && time_now - ReportedTime >= min_interval);
+
+	if (!changed)
+	{
+		return false;
+	}
+
+	ReportedState = State;
+	ReportedIndex = CurrentIndex;
+	ReportedTime = time_now;
+	out_text = GetStatusText();
+	return true;
+}
+
+FString FAURVideoConfigurationSelector::GetStatusText() const
+{
+	switch (State)
+	{
+	case EState::Probing:
+		return FString::Printf(TEXT("Probing %s (%d/%d)"), *Ladder[CurrentIndex].Identifier, CurrentIndex + 1, Ladder.Num());
+	case EState::Monitoring:
+		return FString::Printf(TEXT("Adaptive %s: %.1f fps, processing %.1f ms"), *Ladder[CurrentIndex].Identifier,
+			FrameIntervalAverage > 0 ? 1.0 / FrameIntervalAverage : 0.0, FMath::Max(0.0, ProcessingTimeAverage) * 1000.0);
+	default:
+		return TEXT("Fixed configuration");
+	}
+}
@@ -0,0 +1,225 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "video_sources/AURVideoSource.h"
+#include "AURVideoConfigurationSelector.generated.h"
+
+USTRUCT(BlueprintType)
+struct FAURVideoAutoConfigurationSettings
+{
+	GENERATED_BODY()
+
+	// When a video source offering several resolutions is opened, try each of them
+	// for a moment and keep the highest resolution which meets TargetFPS and LatencyBudget.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource)
+	bool bProbeOnOpen;
+
+	// Step down to a lower resolution if the pipeline does not meet the budget for DowngradeDelay seconds,
+	// and back up if there is enough spare time for UpgradeDelay seconds.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource)
+	bool bAdaptAtRuntime;
+
+	// Frames per second we want to receive and process
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float TargetFPS;
+
+	// Maximal time (milliseconds) spent on detection and conversion of one frame
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float LatencyBudgetMs;
+
+	// Time (seconds) spent measuring each configuration during probing
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "0.25", UIMin = "0.25"))
+	float ProbeDuration;
+
+	// Time (seconds) after opening a configuration during which measurements are ignored,
+	// cameras often deliver the first frames irregularly
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float WarmupDuration;
+
+	// How long (seconds) the budget must be exceeded before switching to a lower resolution
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float DowngradeDelay;
+
+	// How long (seconds) the estimated cost of the higher resolution must fit in the budget before switching up
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float UpgradeDelay;
+
+	// Switch up only if the estimated time for the higher resolution is below LatencyBudget * UpgradeMargin
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = VideoSource, meta = (ClampMin = "0.1", ClampMax = "1.0", UIMin = "0.1", UIMax = "1.0"))
+	float UpgradeMargin;
+
+	FAURVideoAutoConfigurationSettings()
+		: bProbeOnOpen(false)
+		, bAdaptAtRuntime(false)
+		, TargetFPS(25.0)
+		, LatencyBudgetMs(30.0)
+		, ProbeDuration(2.0)
+		, WarmupDuration(0.5)
+		, DowngradeDelay(3.0)
+		, UpgradeDelay(15.0)
+		, UpgradeMargin(0.6)
+	{
+	}
+};
+
+/*
+	Chooses the video configuration (resolution) based on the measured
+	performance of the capture and detection pipeline.
+
+	The candidates are the configurations offered by the opened video source,
+	ordered from the highest to the lowest resolution ("ladder").
+	Not thread safe - used only by the driver's worker thread.
+*/
+class FAURVideoConfigurationSelector
+{
+public:
+	FAURVideoConfigurationSelector();
+
+	void SetSettings(FAURVideoAutoConfigurationSettings const& settings)
+	{
+		Settings = settings;
+	}
+
+	FAURVideoAutoConfigurationSettings const& GetSettings() const
+	{
+		return Settings;
+	}
+
+	/*
+		The user opened this configuration.
+		Builds the ladder from the source's configurations and starts probing or monitoring.
+		If probing starts, out_first_probe is set to the first configuration to try and true is returned.
+	*/
+	bool Begin(FAURVideoConfiguration const& opened_configuration, FAURVideoConfiguration& out_first_probe);
+
+	// Called after the configuration requested by the selector has been connected.
+	void OnConfigurationOpened(double time_now);
+
+	// Stop probing and adaptation.
+	void Reset();
+
+	/*
+		Measurements for one frame:
+			capture_time - time spent waiting in VideoSource::GetNextFrame
+			processing_time - time spent on detection and conversion
+		Returns true and sets out_next if the driver should switch to another configuration.
+	*/
+	bool AddFrameMeasurement(double time_now, double capture_time, double processing_time, FAURVideoConfiguration& out_next);
+
+	/*
+		Should be called on each iteration of the worker loop, even without frames,
+		so that configurations which deliver no frames time out.
+		Returns true and sets out_next if the driver should switch to another configuration.
+	*/
+	bool Update(double time_now, FAURVideoConfiguration& out_next);
+
+	bool IsProbing() const
+	{
+		return State == EState::Probing;
+	}
+
+	FString GetStatusText() const;
+
+	/*
+		GetStatusText only if the state or the configuration changed since the last call,
+		or the measured statistics were last reported more than min_interval (seconds) ago.
+		Returns false without building the text otherwise.
+	*/
+	bool GetStatusTextIfChanged(double time_now, double min_interval, FString& out_text);
+
+protected:
+	enum class EState
+	{
+		Idle,
+		Probing,
+		Monitoring
+	};
+
+	struct FMeasurement
+	{
+		int32 FrameCount;
+		double FirstFrameTime;
+		double LastFrameTime;
+		double CaptureTimeSum;
+		double ProcessingTimeSum;
+
+		FMeasurement()
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			FrameCount = 0;
+			FirstFrameTime = 0;
+			LastFrameTime = 0;
+			CaptureTimeSum = 0;
+			ProcessingTimeSum = 0;
+		}
+
+		void Add(double time_now, double capture_time, double processing_time);
+
+		double GetFPS() const;
+		double GetAverageProcessingTime() const;
+	};
+
+	FAURVideoAutoConfigurationSettings Settings;
+	EState State;
+
+	// Configurations of the current source, from the highest to the lowest resolution
+	TArray<FAURVideoConfiguration> Ladder;
+	int32 CurrentIndex;
+
+	// Probing
+	TArray<FMeasurement> ProbeResults;
+	// Configurations of higher resolution than this were found too slow by probing
+	int32 HighestAllowedIndex;
+
+	// Time when the current configuration was opened, measurements start after the warmup
+	double ConfigurationStartTime;
+	bool bWaitingForConnection;
+	FMeasurement Current;
+
+	// Last status given by GetStatusTextIfChanged, negative time if none
+	EState ReportedState;
+	int32 ReportedIndex;
+	double ReportedTime;
+
+	// Runtime adaptation
+	double ProcessingTimeAverage;
+	double FrameIntervalAverage;
+	double OverBudgetSince;
+	double UnderBudgetSince;
+
+	bool IsWarm(double time_now) const
+	{
+		return !bWaitingForConnection && time_now >= ConfigurationStartTime + Settings.WarmupDuration;
+	}
+
+	bool MeetsTarget(double fps, double processing_time) const;
+
+	// Ends probing of the current candidate, returns true if another configuration should be opened
+	bool FinishProbeStep(FAURVideoConfiguration& out_next);
+
+	bool SwitchTo(int32 ladder_index, FAURVideoConfiguration& out_next);
+
+	void ResetRuntimeStatistics();
+
+	// Ratio of pixel counts between two ladder entries
+	double GetPixelRatio(int32 index_to, int32 index_from) const;
+};
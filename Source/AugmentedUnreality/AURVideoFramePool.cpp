@@ -0,0 +1,210 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURVideoFramePool.h"
+#include "AURLog.h"
+
+// Number of Acquire calls after which unused frames are freed
+static const int32 DEMAND_WINDOW = 300;
+
+// Free frames are kept for this many resolutions besides the current one
+static const int32 MAX_PREVIOUS_RESOLUTIONS = 2;
+
+FAURVideoFramePool::FAURVideoFramePool(int32 max_frames)
+	: Resolution(1, 1)
+	, MaxFrames(FMath::Max(2, max_frames))
+	, FramesInUse(0)
+	, PeakFramesInUse(0)
+	, WindowPeakFramesInUse(0)
+	, WindowAcquireCount(0)
+	, ExhaustionCount(0)
+{
+}
+
+FAURVideoFramePool::~FAURVideoFramePool()
+{
+	// Frames still held by consumers are deleted by FFrameReleaser once the pool is gone
+	ReleaseFreeFrames();
+}
+
+void FAURVideoFramePool::SetResolution(FIntPoint const& resolution)
+{
+	FScopeLock lock(&PoolLock);
+
+	if (resolution != Resolution)
+	{
+		PreviousResolutions.Remove(resolution);
+		PreviousResolutions.Add(Resolution);
+		Resolution = resolution;
+		ReleaseUnusedResolutions();
+	}
+}
+
+FIntPoint FAURVideoFramePool::GetResolution() const
+{
+	FScopeLock lock(&PoolLock);
+	return Resolution;
+}
+
+FAURVideoFrameHandle FAURVideoFramePool::Acquire()
+{
+	FAURVideoFrame* frame = nullptr;
+	FIntPoint resolution;
+
+	{
+		FScopeLock lock(&PoolLock);
+
+		TArray<FAURVideoFrame*>& free_frames = GetFreeFrames(Resolution);
+
+		if (free_frames.Num() == 0 && FramesInUse >= MaxFrames)
+		{
+			ExhaustionCount++;
+			return FAURVideoFrameHandle();
+		}
+
+		if (free_frames.Num() > 0)
+		{
+			frame = free_frames.Pop(false);
+		}
+
+		FramesInUse++;
+		PeakFramesInUse = FMath::Max(PeakFramesInUse, FramesInUse);
+		WindowPeakFramesInUse = FMath::Max(WindowPeakFramesInUse, FramesInUse);
+
+		WindowAcquireCount++;
+		if (WindowAcquireCount >= DEMAND_WINDOW)
+		{
+			TrimToDemand();
+		}
+
+		resolution = Resolution;
+	}
+
+	// Allocate outside of the lock, it is slow for big frames
+	if (!frame)
+	{
+		frame = new FAURVideoFrame(resolution);
+	}
+
+	return FAURVideoFrameHandle(frame, FFrameReleaser{ AsShared() });
+}
+
+void FAURVideoFramePool::ReleaseFreeFrames()
+{
+	FScopeLock lock(&PoolLock);
+
+	for (auto& resolution_frames : FreeFrames)
+	{
+		for (FAURVideoFrame* frame : resolution_frames.Value)
+		{
+			delete frame;
+		}
+	}
+	FreeFrames.Empty();
+}
+
+void FAURVideoFramePool::ReleaseUnusedResolutions()
+{
+	while (PreviousResolutions.Num() > MAX_PREVIOUS_RESOLUTIONS)
+	{
+		TArray<FAURVideoFrame*> frames;
+		if (FreeFrames.RemoveAndCopyValue(PreviousResolutions[0], frames))
+		{
+			for (FAURVideoFrame* frame : frames)
+			{
+				delete frame;
+			}
+		}
+		PreviousResolutions.RemoveAt(0);
+	}
+}
+
+int32 FAURVideoFramePool::GetNumFreeFrames() const
+{
+	int32 num = 0;
+	for (auto const& resolution_frames : FreeFrames)
+	{
+		num += resolution_frames.Value.Num();
+	}
+	return num;
+}
+
+TArray<FAURVideoFrame*>& FAURVideoFramePool::GetFreeFrames(FIntPoint const& resolution)
+{
+	return FreeFrames.FindOrAdd(resolution);
+}
+
+void FAURVideoFramePool::Release(FAURVideoFrame* frame)
+{
+	FScopeLock lock(&PoolLock);
+
+	FramesInUse--;
+
+	if (frame->FrameResolution == Resolution || PreviousResolutions.Contains(frame->FrameResolution))
+	{
+		GetFreeFrames(frame->FrameResolution).Add(frame);
+	}
+	else
+	{
+		delete frame;
+	}
+}
+
+void FAURVideoFramePool::TrimToDemand()
+{
+	// Keep one spare frame above the peak demand of the window, for each kept resolution
+	const int32 frames_to_keep = FMath::Max(0, WindowPeakFramesInUse + 1 - FramesInUse);
+
+	for (auto& resolution_frames : FreeFrames)
+	{
+		TArray<FAURVideoFrame*>& free_frames = resolution_frames.Value;
+		const int32 keep = (resolution_frames.Key == Resolution) ? frames_to_keep : FMath::Min(free_frames.Num(), WindowPeakFramesInUse + 1);
+
+		while (free_frames.Num() > keep)
+		{
+			delete free_frames.Pop(false);
+		}
+	}
+
+	WindowAcquireCount = 0;
+	WindowPeakFramesInUse = FramesInUse;
+}
+
+FAURVideoFramePoolStats FAURVideoFramePool::GetStats() const
+{
+	FScopeLock lock(&PoolLock);
+
+	FAURVideoFramePoolStats stats;
+	stats.AllocatedFrames = FramesInUse + GetNumFreeFrames();
+	stats.FramesInUse = FramesInUse;
+	stats.PeakFramesInUse = PeakFramesInUse;
+	stats.ExhaustionCount = ExhaustionCount;
+	return stats;
+}
+
+void FAURVideoFramePool::FFrameReleaser::operator()(FAURVideoFrame* frame) const
+{
+	TSharedPtr<FAURVideoFramePool, ESPMode::ThreadSafe> pool = Pool.Pin();
+
+	if (pool.IsValid())
+	{
+		pool->Release(frame);
+	}
+	else
+	{
+		delete frame;
+	}
+}
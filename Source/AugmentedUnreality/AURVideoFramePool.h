@@ -0,0 +1,116 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "AURDriver.h"
+#include "AURVideoFramePool.generated.h"
+
+USTRUCT(BlueprintType)
+struct FAURVideoFramePoolStats
+{
+	GENERATED_BODY()
+
+	// Frames currently allocated, in use or free
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 AllocatedFrames;
+
+	// Frames held by the capture thread or consumers
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 FramesInUse;
+
+	// Highest number of frames in use at the same time
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 PeakFramesInUse;
+
+	// How many times a frame was requested while all MaxFrames were in use
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = AugmentedReality)
+	int32 ExhaustionCount;
+
+	FAURVideoFramePoolStats()
+		: AllocatedFrames(0)
+		, FramesInUse(0)
+		, PeakFramesInUse(0)
+		, ExhaustionCount(0)
+	{
+	}
+};
+
+/*
+	Thread-safe pool of video frames handed out as ref-counted FAURVideoFrameHandle.
+	A released frame returns to the pool if the pool still exists.
+	Free frames are kept per resolution, so switching between a few resolutions does not allocate after the first switch.
+
+	The pool grows when all frames are held by consumers, up to MaxFrames.
+	Frames which were not needed during the last few hundred requests are freed again.
+*/
+class FAURVideoFramePool : public TSharedFromThis<FAURVideoFramePool, ESPMode::ThreadSafe>
+{
+public:
+	FAURVideoFramePool(int32 max_frames);
+	~FAURVideoFramePool();
+
+	// Free frames of the previous resolution are kept for a later switch back
+	void SetResolution(FIntPoint const& resolution);
+
+	FIntPoint GetResolution() const;
+
+	/*
+		Get a frame of the current resolution, its content is undefined.
+		Returns null if MaxFrames are already in use.
+	*/
+	FAURVideoFrameHandle Acquire();
+
+	// Free the memory of frames not held by anyone
+	void ReleaseFreeFrames();
+
+	FAURVideoFramePoolStats GetStats() const;
+
+protected:
+	mutable FCriticalSection PoolLock;
+
+	FIntPoint Resolution;
+	int32 MaxFrames;
+
+	// Free frames by resolution, frames are always in the FColor format
+	TMap<FIntPoint, TArray<FAURVideoFrame*>> FreeFrames;
+	// Resolutions used before the current one, most recent last
+	TArray<FIntPoint> PreviousResolutions;
+	int32 FramesInUse;
+
+	// Demand tracking, the pool is trimmed to the peak demand of the last window
+	int32 PeakFramesInUse;
+	int32 WindowPeakFramesInUse;
+	int32 WindowAcquireCount;
+	int32 ExhaustionCount;
+
+	void Release(FAURVideoFrame* frame);
+	void TrimToDemand();
+
+	int32 GetNumFreeFrames() const;
+	TArray<FAURVideoFrame*>& GetFreeFrames(FIntPoint const& resolution);
+
+	// Free the frames of resolutions which were not used recently
+	void ReleaseUnusedResolutions();
+
+	// Returns the frame to the pool, or deletes it if the pool is gone
+	struct FFrameReleaser
+	{
+		TWeakPtr<FAURVideoFramePool, ESPMode::ThreadSafe> Pool;
+
+		void operator()(FAURVideoFrame* frame) const;
+	};
+};
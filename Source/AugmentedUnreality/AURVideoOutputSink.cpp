@@ -0,0 +1,314 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURVideoOutputSink.h"
+#include "AURLog.h"
+#include "HAL/PlatformFilemanager.h"
+
+// Colors (BGR) of the overlay drawn into the output frames
+static const cv::Scalar OVERLAY_MARKER_COLOR(0, 255, 0);
+static const cv::Scalar OVERLAY_RESIDUAL_COLOR(255, 0, 255);
+static const cv::Scalar OVERLAY_CALIBRATION_COLOR(0, 255, 255);
+
+static void DrawFrameOverlay(cv::Mat& image, FAURFrameOverlay const& overlay)
+{
+	const FVector2D image_size(image.cols, image.rows);
+	auto to_image = [&](FVector2D const& pt) {
+		const FVector2D px = pt * image_size;
+		return cv::Point(FMath::RoundToInt(px.X), FMath::RoundToInt(px.Y));
+	};
+
+	for (FAURMarkerOverlay const& marker : overlay.Markers)
+	{
+		const int32 num_corners = marker.Corners.Num();
+		for (int32 idx = 0; idx < num_corners; idx++)
+		{
+			cv::line(image, to_image(marker.Corners[idx]), to_image(marker.Corners[(idx + 1) % num_corners]), OVERLAY_MARKER_COLOR, 2);
+		}
+
+		for (int32 idx = 0; idx < FMath::Min(num_corners, marker.ReprojectedCorners.Num()); idx++)
+		{
+			cv::line(image, to_image(marker.Corners[idx]), to_image(marker.ReprojectedCorners[idx]), OVERLAY_RESIDUAL_COLOR, 1);
+		}
+
+		if (num_corners > 0)
+		{
+			cv::putText(image, std::to_string(marker.MarkerId), to_image(marker.Corners[0]), cv::FONT_HERSHEY_SIMPLEX, 0.5, OVERLAY_MARKER_COLOR);
+		}
+	}
+
+	for (FAURBoardOverlay const& board : overlay.Boards)
+	{
+		const cv::Point origin = to_image(board.Origin);
+		cv::line(image, origin, to_image(board.AxisX), cv::Scalar(0, 0, 255), 2);
+		cv::line(image, origin, to_image(board.AxisY), cv::Scalar(0, 255, 0), 2);
+		cv::line(image, origin, to_image(board.AxisZ), cv::Scalar(255, 0, 0), 2);
+	}
+
+	for (FVector2D const& pt : overlay.CalibrationPoints)
+	{
+		cv::drawMarker(image, to_image(pt), OVERLAY_CALIBRATION_COLOR, cv::MARKER_CROSS, 8, 2);
+	}
+}
+
+FAURVideoOutputSink::FAURVideoOutputSink(FAUROutputStreamSettings const& settings)
+	: Settings(settings)
+	, FrameAvailableEvent(nullptr)
+	, bContinue(false)
+{
+	Settings.QueueCapacity = FMath::Max(1, Settings.QueueCapacity);
+	FrameAvailableEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+FAURVideoOutputSink::~FAURVideoOutputSink()
+{
+	Shutdown();
+
+	FPlatformProcess::ReturnSynchEventToPool(FrameAvailableEvent);
+	FrameAvailableEvent = nullptr;
+}
+
+bool FAURVideoOutputSink::Start()
+{
+	if (Thread.IsValid())
+	{
+		return true;
+	}
+
+	bContinue = true;
+	Thread.Reset(FRunnableThread::Create(this, TEXT("AUR_OutputStreamThread"), 0, TPri_BelowNormal));
+	return Thread.IsValid();
+}
+
+void FAURVideoOutputSink::Shutdown()
+{
+	if (Thread.IsValid())
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		Thread.Reset(nullptr);
+	}
+}
+
+void FAURVideoOutputSink::PushFrame(cv::Mat const& frame, FAURFrameOverlay const* overlay)
+{
+	if (!bContinue)
+	{
+		return;
+	}
+
+	FQueuedFrame buffer;
+
+	{
+		FScopeLock lock(&QueueLock);
+		if (FreeBuffers.Num() > 0)
+		{
+			buffer = FreeBuffers.Pop(false);
+		}
+	}
+
+	// Copy outside of the lock, the encoder may be waiting for it.
+	// copyTo reuses the buffer's memory if the size has not changed.
+	frame.copyTo(buffer.Image);
+
+	buffer.Overlay.Reset();
+	if (overlay)
+	{
+		buffer.Overlay = *overlay;
+	}
+
+	{
+		FScopeLock lock(&QueueLock);
+
+		// Drop the oldest frame rather than wait for the encoder
+		if (Queue.Num() >= Settings.QueueCapacity)
+		{
+			FreeBuffers.Add(MoveTemp(Queue[0]));
+			Queue.RemoveAt(0, 1, false);
+			DroppedFrameCount.Increment();
+		}
+
+		Queue.Add(MoveTemp(buffer));
+	}
+
+	FrameAvailableEvent->Trigger();
+}
+
+bool FAURVideoOutputSink::Init()
+{
+	UE_LOG(LogAUR, Log, TEXT("FAURVideoOutputSink: Encoder thread init"))
+	return true;
+}
+
+uint32 FAURVideoOutputSink::Run()
+{
+	while (bContinue)
+	{
+		// Wake up periodically to check bContinue
+		FrameAvailableEvent->Wait(FTimespan::FromMilliseconds(100));
+
+		while (bContinue && WriteNextFrame())
+		{
+		}
+	}
+
+	// PushFrame no longer accepts frames, finish the recording with the ones queued before Stop
+	while (WriteNextFrame())
+	{
+	}
+
+	CloseWriter();
+
+	UE_LOG(LogAUR, Log, TEXT("FAURVideoOutputSink: Encoder thread ends, written %d frames, dropped %d"),
+		GetWrittenFrameCount(), GetDroppedFrameCount())
+
+	return 0;
+}
+
+bool FAURVideoOutputSink::WriteNextFrame()
+{
+	FQueuedFrame frame;
+	{
+		FScopeLock lock(&QueueLock);
+		if (Queue.Num() == 0)
+		{
+			return false;
+		}
+		frame = MoveTemp(Queue[0]);
+		Queue.RemoveAt(0, 1, false);
+	}
+
+	if (!frame.Overlay.IsEmpty())
+	{
+		DrawFrameOverlay(frame.Image, frame.Overlay);
+	}
+
+	// (Re)open only when the frame size changes, a broken pipeline is not retried on every frame
+	if (frame.Image.size() != WriterFrameSize)
+	{
+		OpenWriter(frame.Image.size());
+	}
+
+	if (Writer.isOpened())
+	{
+		Writer.write(frame.Image);
+		WrittenFrameCount.Increment();
+	}
+	else
+	{
+		DroppedFrameCount.Increment();
+	}
+
+	{
+		FScopeLock lock(&QueueLock);
+		FreeBuffers.Add(MoveTemp(frame));
+	}
+
+	return true;
+}
+
+void FAURVideoOutputSink::Stop()
+{
+	bContinue = false;
+
+	if (FrameAvailableEvent)
+	{
+		FrameAvailableEvent->Trigger();
+	}
+}
+
+bool FAURVideoOutputSink::OpenWriter(cv::Size const& frame_size)
+{
+	CloseWriter();
+	WriterFrameSize = frame_size;
+
+	const double fps = FMath::Max(1.0f, Settings.FramesPerSecond);
+
+#if !PLATFORM_ANDROID
+	try
+	{
+#endif
+		if (Settings.Target == EAUROutputStreamTarget::AUROS_File && Settings.CustomPipeline.IsEmpty())
+		{
+			const FString file_path = GetOutputFileFullPath();
+			FPlatformFileManager::Get().GetPlatformFile().CreateDirectoryTree(*FPaths::GetPath(file_path));
+
+			const bool is_avi = FPaths::GetExtension(file_path).Equals(TEXT("avi"), ESearchCase::IgnoreCase);
+			const int fourcc = is_avi ? cv::VideoWriter::fourcc('M', 'J', 'P', 'G') : cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+
+			UE_LOG(LogAUR, Log, TEXT("FAURVideoOutputSink: Writing %dx%d to file %s"), frame_size.width, frame_size.height, *file_path)
+			Writer.open(TCHAR_TO_UTF8(*file_path), cv::CAP_FFMPEG, fourcc, fps, frame_size, true);
+		}
+		else
+		{
+			const FString pipeline = BuildGstreamerPipeline();
+
+			UE_LOG(LogAUR, Log, TEXT("FAURVideoOutputSink: Streaming %dx%d to %s"), frame_size.width, frame_size.height, *pipeline)
+			Writer.open(TCHAR_TO_UTF8(*pipeline), cv::CAP_GSTREAMER, 0, fps, frame_size, true);
+		}
+#if !PLATFORM_ANDROID
+	}
+	catch (std::exception& exc)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURVideoOutputSink: cv::VideoWriter::open exception\n    %s"), UTF8_TO_TCHAR(exc.what()))
+	}
+#endif
+
+	const bool opened = Writer.isOpened();
+	if (!opened)
+	{
+		UE_LOG(LogAUR, Error, TEXT("FAURVideoOutputSink: Failed to open the output, frames will be discarded"))
+	}
+
+	return opened;
+}
+
+void FAURVideoOutputSink::CloseWriter()
+{
+	if (Writer.isOpened())
+	{
+		Writer.release();
+	}
+	WriterFrameSize = cv::Size();
+}
+
+FString FAURVideoOutputSink::BuildGstreamerPipeline() const
+{
+	if (!Settings.CustomPipeline.IsEmpty())
+	{
+		return Settings.CustomPipeline;
+	}
+
+	switch (Settings.Target)
+	{
+	case EAUROutputStreamTarget::AUROS_LocalSocket:
+		return FString::Printf(
+			TEXT("appsrc ! videoconvert ! jpegenc ! multipartmux ! tcpserversink host=127.0.0.1 port=%d sync=false"),
+			Settings.Port);
+
+	case EAUROutputStreamTarget::AUROS_UDP:
+	default:
+		// Counterpart of the default pipeline of UAURVideoSourceStream
+		return FString::Printf(
+			TEXT("appsrc ! videoconvert ! x264enc tune=zerolatency speed-preset=ultrafast bitrate=%d ! rtph264pay config-interval=1 pt=96 ! udpsink host=%s port=%d sync=false"),
+			Settings.BitrateKbps, *Settings.Host, Settings.Port);
+	}
+}
+
+FString FAURVideoOutputSink::GetOutputFileFullPath() const
+{
+	return FPaths::ProjectSavedDir() / Settings.FilePath;
+}
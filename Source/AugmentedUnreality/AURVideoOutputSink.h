@@ -0,0 +1,168 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "AUROpenCV.h"
+#include "AURFrameOverlay.h"
+#include "AURVideoOutputSink.generated.h"
+
+UENUM(BlueprintType)
+enum class EAUROutputStreamTarget : uint8
+{
+	// Video file encoded through FFmpeg, the container is chosen from the extension (.avi - MJPG, otherwise MPEG-4)
+	AUROS_File = 0		UMETA(DisplayName = "File"),
+	// H264 over RTP/UDP - can be received by the "Stream" video source
+	AUROS_UDP = 1		UMETA(DisplayName = "UDP (H264/RTP)"),
+	// MJPEG served by a TCP server on localhost, for tests and local monitoring
+	AUROS_LocalSocket = 2	UMETA(DisplayName = "Local socket (MJPEG/TCP)")
+};
+
+USTRUCT(BlueprintType)
+struct FAUROutputStreamSettings
+{
+	GENERATED_BODY()
+
+	// Start the stream when the driver is initialized
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	bool bEnabled;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	EAUROutputStreamTarget Target;
+
+	// Draw the diagnostic overlay (detected markers, board axes) into the sent frames
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	bool bIncludeDiagnosticOverlay;
+
+	// Output file, relative to FPaths::ProjectSavedDir()
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	FString FilePath;
+
+	// Destination of UDP packets
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	FString Host;
+
+	// UDP destination port, or the port of the local TCP server
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	int32 Port;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream, meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float FramesPerSecond;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream, meta = (ClampMin = "100", UIMin = "100"))
+	int32 BitrateKbps;
+
+	// Maximal number of frames waiting for the encoder, the oldest are dropped when it is full
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream, meta = (ClampMin = "1", UIMin = "1"))
+	int32 QueueCapacity;
+
+	// If not empty, this GStreamer pipeline (starting with "appsrc !") is used instead of the one derived from Target
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = OutputStream)
+	FString CustomPipeline;
+
+	FAUROutputStreamSettings()
+		: bEnabled(false)
+		, Target(EAUROutputStreamTarget::AUROS_UDP)
+		, bIncludeDiagnosticOverlay(true)
+		, FilePath("AugmentedUnreality/Recordings/ar_output.avi")
+		, Host("127.0.0.1")
+		, Port(5000)
+		, FramesPerSecond(30.0)
+		, BitrateKbps(2048)
+		, QueueCapacity(4)
+	{
+	}
+};
+
+/*
+	Encodes frames published by the driver on its own thread.
+	PushFrame only copies the frame into a bounded queue (dropping the oldest frame if full),
+	so a stalled encoder never slows down capture or tracking.
+*/
+class FAURVideoOutputSink : public FRunnable
+{
+public:
+	FAURVideoOutputSink(FAUROutputStreamSettings const& settings);
+	virtual ~FAURVideoOutputSink();
+
+	// Spawn the encoder thread
+	bool Start();
+
+	// Stop the encoder thread and close the output
+	void Shutdown();
+
+	// Copy the frame into the queue. Never waits for the encoder.
+	// The overlay, if given, is drawn into the copy by the encoder thread.
+	void PushFrame(cv::Mat const& frame, FAURFrameOverlay const* overlay = nullptr);
+
+	FAUROutputStreamSettings const& GetSettings() const
+	{
+		return Settings;
+	}
+
+	int32 GetWrittenFrameCount() const
+	{
+		return WrittenFrameCount.GetValue();
+	}
+
+	int32 GetDroppedFrameCount() const
+	{
+		return DroppedFrameCount.GetValue();
+	}
+
+	// Begin FRunnable interface.
+	virtual bool Init() override;
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	// End FRunnable interface
+
+protected:
+	FAUROutputStreamSettings Settings;
+
+	struct FQueuedFrame
+	{
+		cv::Mat Image;
+		FAURFrameOverlay Overlay;
+	};
+
+	// Queue of frames to encode, oldest first, and buffers which can be reused for new frames
+	FCriticalSection QueueLock;
+	TArray<FQueuedFrame> Queue;
+	TArray<FQueuedFrame> FreeBuffers;
+	FEvent* FrameAvailableEvent;
+
+	FThreadSafeBool bContinue;
+	TUniquePtr<FRunnableThread> Thread;
+
+	// Used only by the encoder thread
+	cv::VideoWriter Writer;
+	cv::Size WriterFrameSize;
+
+	FThreadSafeCounter WrittenFrameCount;
+	FThreadSafeCounter DroppedFrameCount;
+
+	// Encode the oldest queued frame, returns false if the queue is empty
+	bool WriteNextFrame();
+
+	bool OpenWriter(cv::Size const& frame_size);
+	void CloseWriter();
+
+	FString BuildGstreamerPipeline() const;
+	FString GetOutputFileFullPath() const;
+};
@@ -46,17 +46,23 @@ void UAURVideoScreenBase::UseDriver(UAURDriver* new_driver)
 	if (VideoDriver)
 	{
 		VideoDriver->OnVideoPropertiesChange.RemoveAll(this);
+		VideoDriver->OnOutputTextureChange.RemoveAll(this);
+		VideoDriver->RemoveFrameConsumer(this);
 	}
 
 	VideoDriver = new_driver;
 
 	if (VideoDriver)
 	{
+		// The driver produces video only while someone displays it
+		VideoDriver->AddFrameConsumer(this);
+
 		// Switch to this driver's texture
 		OnCameraPropertiesChange(VideoDriver);
 
 		// Subscribe to future changes
 		VideoDriver->OnVideoPropertiesChange.AddUniqueDynamic(this, &UAURVideoScreenBase::OnCameraPropertiesChange);
+		VideoDriver->OnOutputTextureChange.AddUniqueDynamic(this, &UAURVideoScreenBase::OnOutputTextureChange);
 	}
 	else
 	{
@@ -74,6 +80,14 @@ void UAURVideoScreenBase::OnCameraPropertiesChange(UAURDriver* Driver)
 	}
 }
 
+void UAURVideoScreenBase::OnOutputTextureChange(UAURDriver* Driver)
+{
+	if (VideoDriver && VideoMaterial)
+	{
+		this->VideoMaterial->SetTextureParameterValue(FName("VideoTexture"), VideoDriver->GetOutputTexture());
+	}
+}
+
 void UAURVideoScreenBase::BeginPlay()
 {
 	Super::BeginPlay();
@@ -97,6 +111,13 @@ void UAURVideoScreenBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	UAURDriver::UnbindOnDriverInstanceChange(this);
 
+	if (VideoDriver)
+	{
+		VideoDriver->OnVideoPropertiesChange.RemoveAll(this);
+		VideoDriver->OnOutputTextureChange.RemoveAll(this);
+		VideoDriver->RemoveFrameConsumer(this);
+	}
+
 	Super::EndPlay(EndPlayReason);
 }
 
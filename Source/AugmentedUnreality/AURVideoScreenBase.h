@@ -46,6 +46,10 @@ public:
 	UFUNCTION(BlueprintCallable, Category = AugmentedReality)
 	virtual void OnCameraPropertiesChange(UAURDriver* Driver);
 
+	// Follow the driver's texture ring
+	UFUNCTION()
+	void OnOutputTextureChange(UAURDriver* Driver);
+
 	UAURVideoScreenBase();
 
 	/* UActorComponent */
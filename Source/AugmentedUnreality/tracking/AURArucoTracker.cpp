@@ -19,6 +19,7 @@ limitations under the License.
 
 #include <vector>
 #include <functional>
+#include <algorithm>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -35,11 +36,21 @@ the Z axis onto the X axis.
 const FTransform FAURArucoTracker::CameraAdditionalRotation = FTransform(FQuat(FVector(0, 1, 0), -M_PI / 2), FVector(0, 0, 0), FVector(1, 1, 1));
 
 FAURArucoTracker::FAURArucoTracker()
-	: ViewpointPoseDetectedOnLastTick(false)
+	: ViewpointSequence(0)
+	, ViewpointHistory(MakeShared<FAURPoseHistory, ESPMode::ThreadSafe>())
+	, ProcessedFrameCount(0)
+	, NotifiedViewpointSequence(0)
+	, PublishedViewpointTransform(FTransform::Identity)
+	, PublishedViewpointSequence(0)
+	, ViewpointDetectedInFrame(false)
+	, ViewpointMeasurementInFrame(FTransform::Identity)
+	, ViewpointDetectedOnLastDetection(false)
+	, MaxPoseSpeed(0)
+	, MaxRotationSpeed(0)
+	, LastBoardLossTime(-1.0)
+	, NextFrameTime(-1.0)
 	, ViewpointTransform(FTransform::Identity)
 {
-	ViewpointTransformCamera = CameraAdditionalRotation * ViewpointTransform;
-
 	cv::aur::setLogCallback([](cv::aur::LogLevel level, std::string const& msg) {
 		switch(level)
 		{
@@ -59,92 +70,478 @@ FAURArucoTracker::FAURArucoTracker()
 
 }
 
+void FAURArucoTracker::FMotionState::Update(FTransform const& transform, double time)
+{
+	const double dt = time - Time;
+
+	if (bHasTransform && dt > 0)
+	{
+		LinearVelocity = (transform.GetTranslation() - Transform.GetTranslation()) / dt;
+
+		FQuat delta = transform.GetRotation() * Transform.GetRotation().Inverse();
+		// shortest way
+		if (delta.W < 0)
+		{
+			delta *= -1.0f;
+		}
+
+		FVector axis;
+		float angle;
+		delta.ToAxisAndAngle(axis, angle);
+		AngularVelocity = axis * (angle / dt);
+
+		bHasVelocity = true;
+	}
+
+	Transform = transform;
+	Time = time;
+	bHasTransform = true;
+}
+
+FTransform FAURArucoTracker::FMotionState::Predict(double time) const
+{
+	if (!bHasVelocity)
+	{
+		return Transform;
+	}
+
+	const float dt = time - Time;
+	const float angular_speed = AngularVelocity.Size();
+
+	FTransform predicted = Transform;
+	predicted.AddToTranslation(LinearVelocity * dt);
+	if (angular_speed > SMALL_NUMBER)
+	{
+		predicted.SetRotation(FQuat(AngularVelocity / angular_speed, angular_speed * dt) * Transform.GetRotation());
+	}
+	return predicted;
+}
+
 void FAURArucoTracker::SetSettings(FArucoTrackerSettings const& settings)
 {
 	this->Settings = settings;
+
+	Commands.Enqueue([this, settings]() {
+		TrackerModule.setChangeGating(settings.bReuseStaticDetections, settings.StaticChangeThreshold, settings.StaticRefreshInterval);
+	});
 }
 
 void FAURArucoTracker::SetCameraProperties(FOpenCVCameraProperties const & camera_properties)
 {
 	this->CameraProperties = camera_properties;
-	TrackerModule.setCameraInfo(camera_properties.CameraMatrix, camera_properties.DistortionCoefficients);
+
+	Commands.Enqueue([this, camera_properties]() {
+		TrackerModule.setCameraInfo(camera_properties.CameraMatrix, camera_properties.DistortionCoefficients);
+	});
 }
 
-bool FAURArucoTracker::DetectMarkers(cv::Mat_<cv::Vec3b>& image, bool draw_found_markers)
+void FAURArucoTracker::ApplyCommands()
 {
+	TFunction<void()> command;
+	while (Commands.Dequeue(command))
+	{
+		command();
+	}
+}
+
+bool FAURArucoTracker::DetectMarkers(cv::Mat_<cv::Vec3b> const& image, bool draw_found_markers)
+{
+	ApplyCommands();
+
 	// this outside of lock so doesn't block
 	TrackerModule.processFrame(image);
 
+	return UpdateDetectedPoses();
+}
+
+bool FAURArucoTracker::DetectMarkers(cv::Mat_<cv::Vec3b> const& image, cv::Mat_<uint8> const& image_grey)
+{
+	ApplyCommands();
+
+	TrackerModule.processFrame(image, image_grey);
+
+	return UpdateDetectedPoses();
+}
+
+void FAURArucoTracker::GetFrameOverlay(FAURFrameOverlay& out_overlay) const
+{
+	cv::aur::FrameDiagnostics const& diagnostics = TrackerModule.getFrameDiagnostics();
+	if (diagnostics.imageSize.area() <= 0)
+	{
+		return;
+	}
+
+	const FVector2D image_size(diagnostics.imageSize.width, diagnostics.imageSize.height);
+	auto to_relative = [&](cv::Point2f const& pt) {
+		return FVector2D(pt.x, pt.y) / image_size;
+	};
+
+	for (size_t mk_idx = 0; mk_idx < diagnostics.markerIds.size(); mk_idx++)
+	{
+		FAURMarkerOverlay& marker = out_overlay.Markers[out_overlay.Markers.AddDefaulted()];
+		marker.MarkerId = diagnostics.markerIds[mk_idx];
+
+		for (cv::Point2f const& pt : diagnostics.markerCorners[mk_idx])
+		{
+			marker.Corners.Add(to_relative(pt));
+		}
+
+		for (cv::Point2f const& pt : diagnostics.reprojectedCorners[mk_idx])
+		{
+			marker.ReprojectedCorners.Add(to_relative(pt));
+		}
+	}
+
+	for (cv::aur::FrameDiagnostics::BoardAxes const& axes : diagnostics.boards)
 	{
-		FScopeLock lock(&PoseLock);
+		FAURBoardOverlay& board = out_overlay.Boards[out_overlay.Boards.AddDefaulted()];
+		board.BoardId = axes.poseId;
+		board.Origin = to_relative(axes.origin);
+		board.AxisX = to_relative(axes.axisEnds[0]);
+		board.AxisY = to_relative(axes.axisEnds[1]);
+		board.AxisZ = to_relative(axes.axisEnds[2]);
+		board.ReprojectionError = axes.reprojectionError;
+	}
+}
+
+bool FAURArucoTracker::UpdateDetectedPoses()
+{
+	const double time_now = (NextFrameTime >= 0) ? NextFrameTime : FPlatformTime::Seconds();
+	NextFrameTime = -1.0;
+	TArray<int32> detected_board_ids;
+	float max_pose_speed = 0;
+	float max_rotation_speed = 0;
+
+	ViewpointDetectedInFrame = false;
+	BoardMeasurementsInFrame.Reset();
+
+	FPoseSnapshot& snapshot = PoseSnapshots.GetWriteBuffer();
+	snapshot.Boards.Reset();
+
+	// Raw measurements of boards, stored in the histories once the viewpoint of this frame is known
+	TArray<TPair<TrackedBoardInfo*, FTransform>, TInlineAllocator<8>> board_measurements;
 
-		DetectedBoards.Empty();
-		for (auto detected_pose : TrackerModule.getDetectedPoses())
+	for (auto detected_pose : TrackerModule.getDetectedPoses())
+	{
+		TrackedBoardInfo* tbi = (TrackedBoardInfo*)detected_pose->userObject;
+
+		// Write the projection matrix to Unreal's datastructures
+		FMatrix t_mat;
+		t_mat.SetIdentity();
+
+		// Unreal's projection matrices are for some reason transposed from the traditional representation
+		// so we index [c][r] to contruct that transposed mat
+
+		cv::Mat_<double> const& detected_rot = detected_pose->getRotationCameraUnreal();
+		for (int32 r : {0, 1, 2}) for (int32 c : {0, 1, 2})
 		{
-			TrackedBoardInfo* tbi = (TrackedBoardInfo*)detected_pose->userObject;
+			t_mat.M[c][r] = detected_rot(r, c);
+		}
 
-			// Write the projection matrix to Unreal's datastructures
-			FMatrix t_mat;
-			t_mat.SetIdentity();
+		cv::Mat_<double> const& detected_trans = detected_pose->getTranslationCameraUnreal();
+		for (int32 r : {0, 1, 2})
+		{
+			t_mat.M[3][r] = detected_trans(r);
+		}
 
-			// Unreal's projection matrices are for some reason transposed from the traditional representation
-			// so we index [c][r] to contruct that transposed mat
+		if (!t_mat.ContainsNaN())
+		{
+			const float blend_factor = (1.0 - Settings.SmoothingStrength);
+			FTransform detected_transform(t_mat);
 
-			cv::Mat_<double> const& detected_rot = detected_pose->getRotationCameraUnreal();
-			for (int32 r : {0, 1, 2}) for (int32 c : {0, 1, 2})
+			if (tbi->UseAsViewpointOrigin)
 			{
-				t_mat.M[c][r] = detected_rot(r, c);
-			}
+				
+				// Transforms are from right to left:
+				// - outer: board actor transform => but board actor in center
+				// - middle: camera transform from AR marker => move from board to camera looking at board
+				// - inner: rotate to look forward 
+				detected_transform *= tbi->BoardActorTransform;
+
+				ViewpointMeasurementInFrame = detected_transform;
+				ViewpointDetectedInFrame = true;
+
+				// Blend the viewport transform
+				ViewpointTransform.BlendWith(detected_transform, blend_factor);
+				ViewpointSequence++;
 
-			cv::Mat_<double> const& detected_trans = detected_pose->getTranslationCameraUnreal();
-			for (int32 r : {0, 1, 2})
+				ViewpointHistory->Add(time_now, CameraAdditionalRotation * detected_transform, CameraAdditionalRotation * ViewpointTransform);
+
+				ViewpointMotion.Update(ViewpointTransform, time_now);
+				max_pose_speed = FMath::Max(max_pose_speed, ViewpointMotion.LinearVelocity.Size());
+				max_rotation_speed = FMath::Max(max_rotation_speed, ViewpointMotion.AngularVelocity.Size());
+			}
+			else
 			{
-				t_mat.M[3][r] = detected_trans(r);
+				// Smoothly merge measured transform with current transform
+				tbi->CurrentTransform.BlendWith(detected_transform, blend_factor);
+				const float quality = float(detected_pose->getNumFoundMarkers()) / FMath::Max(1, detected_pose->getNumPatternMarkers());
+				snapshot.Boards.Add({ tbi->Id, tbi->BoardActor, tbi->CurrentTransform, quality, time_now });
+				board_measurements.Emplace(tbi, detected_transform);
+
+				// Relative to the camera looking forward, like GetFrameViewpointMeasurement
+				BoardMeasurementsInFrame.Add({ tbi->Id, detected_transform.Inverse() * CameraAdditionalRotation.Inverse(), quality });
+
+				tbi->Motion.Update(tbi->CurrentTransform, time_now);
+				max_pose_speed = FMath::Max(max_pose_speed, tbi->Motion.LinearVelocity.Size());
+				max_rotation_speed = FMath::Max(max_rotation_speed, tbi->Motion.AngularVelocity.Size());
 			}
+			detected_board_ids.Add(tbi->Id);			
+		}
+		else
+		{
+			UE_LOG(LogAUR, Warning, TEXT("Wrong transform matrix %s"), *t_mat.ToString());
+		}
+	}
 
-			if (!t_mat.ContainsNaN())
+	for (auto const& measurement : board_measurements)
+	{
+		TrackedBoardInfo* tbi = measurement.Key;
+		if (tbi->History.IsValid())
+		{
+			tbi->History->Add(time_now,
+				measurement.Value.GetRelativeTransformReverse(ViewpointTransform),
+				tbi->CurrentTransform.GetRelativeTransformReverse(ViewpointTransform));
+		}
+	}
+
+	for (int32 previous_id : LastDetectedBoardIds)
+	{
+		if (!detected_board_ids.Contains(previous_id))
+		{
+			LastBoardLossTime = time_now;
+			break;
+		}
+	}
+
+	LastDetectedBoardIds = detected_board_ids;
+	ViewpointDetectedOnLastDetection = ViewpointDetectedInFrame;
+	MaxPoseSpeed = max_pose_speed;
+	// AngularVelocity is in radians/s
+	MaxRotationSpeed = FMath::RadiansToDegrees(max_rotation_speed);
+
+	PublishPoseSnapshot(time_now, false);
+
+	return true;
+}
+
+void FAURArucoTracker::PublishPoseSnapshot(double frame_time, bool predicted)
+{
+	FPoseSnapshot& snapshot = PoseSnapshots.GetWriteBuffer();
+	snapshot.ViewpointSequence = ViewpointSequence;
+	snapshot.ViewpointTransform = ViewpointTransform;
+
+	ProcessedFrameCount++;
+	NotifyPoseListeners(snapshot, frame_time, predicted);
+
+	PoseSnapshots.SwapWriteBuffers();
+}
+
+void FAURArucoTracker::AddPoseListener(FAURPoseListenerRef const& listener)
+{
+	FScopeLock lock(&PoseListenersLock);
+	PoseListeners.AddUnique(listener);
+}
+
+void FAURArucoTracker::RemovePoseListener(FAURPoseListenerRef const& listener)
+{
+	FScopeLock lock(&PoseListenersLock);
+	PoseListeners.Remove(listener);
+}
+
+void FAURArucoTracker::NotifyPoseListeners(FPoseSnapshot const& snapshot, double frame_time, bool predicted)
+{
+	const bool viewpoint_updated = snapshot.ViewpointSequence != NotifiedViewpointSequence;
+	NotifiedViewpointSequence = snapshot.ViewpointSequence;
+
+	// Copy so that the listeners are called without the lock, they may add or remove listeners
+	TArray<FAURPoseListenerRef> listeners;
+	{
+		FScopeLock lock(&PoseListenersLock);
+		if (PoseListeners.Num() == 0)
+		{
+			return;
+		}
+		listeners = PoseListeners;
+	}
+
+	TSharedRef<FAURPoseBatch, ESPMode::ThreadSafe> poses = MakeShared<FAURPoseBatch, ESPMode::ThreadSafe>();
+	for (FBoardMeasurement const& measurement : snapshot.Boards)
+	{
+		// Relative to the viewpoint like in PublishTransformUpdate, but without skipping small changes
+		poses->Add(measurement.BoardId, measurement.BoardActor,
+			measurement.Transform.GetRelativeTransformReverse(snapshot.ViewpointTransform), measurement.Quality, measurement.Time);
+	}
+
+	FAURPoseFrame frame(poses);
+	frame.FrameId = ProcessedFrameCount;
+	frame.Timestamp = frame_time;
+	frame.bPredicted = predicted;
+	frame.bViewpointUpdated = viewpoint_updated;
+	frame.ViewpointTransform = CameraAdditionalRotation * snapshot.ViewpointTransform; // rotate so camera looks forward
+
+	for (FAURPoseListenerRef const& listener : listeners)
+	{
+		listener->OnPosesSolved(frame);
+	}
+}
+
+bool FAURArucoTracker::GetFrameChessboardCorners(std::vector<cv::Point2f>& out_corners, std::vector<int>& out_ids,
+	cv::Ptr<cv::aruco::CharucoBoard>& out_board) const
+{
+	// A reused detection would give the same view again
+	if (TrackerModule.wasDetectionReused())
+	{
+		return false;
+	}
+
+	// Also boards whose pose failed, it was solved with the camera model being calibrated
+	cv::aur::TrackedPose const* best_pose = nullptr;
+	for (cv::aur::TrackedPose const* pose : TrackerModule.getFoundPoses())
+	{
+		if (pose->getPattern()->getCharucoBoard()
+			&& (!best_pose || pose->getChessboardCorners().size() > best_pose->getChessboardCorners().size()))
+		{
+			best_pose = pose;
+		}
+	}
+
+	if (!best_pose)
+	{
+		return false;
+	}
+
+	out_corners = best_pose->getChessboardCorners();
+	out_ids = best_pose->getChessboardCornerIds();
+	out_board = best_pose->getPattern()->getCharucoBoard();
+	return true;
+}
+
+void FAURArucoTracker::SetUseCameraModelForCorners(bool use_camera_model)
+{
+	Commands.Enqueue([this, use_camera_model]() {
+		TrackerModule.setUseCameraModelForCorners(use_camera_model);
+	});
+}
+
+bool FAURArucoTracker::PredictPoses(double time_now)
+{
+	ApplyCommands();
+
+	bool predicted_any = false;
+	const double max_time = Settings.MaxPredictionTime;
+
+	// Predictions are not measurements
+	ViewpointDetectedInFrame = false;
+	BoardMeasurementsInFrame.Reset();
+
+	FPoseSnapshot& snapshot = PoseSnapshots.GetWriteBuffer();
+	snapshot.Boards.Reset();
+
+	if (ViewpointDetectedOnLastDetection && time_now - ViewpointMotion.Time <= max_time)
+	{
+		ViewpointTransform = ViewpointMotion.Predict(time_now);
+		ViewpointSequence++;
+		predicted_any = true;
+
+		// Otherwise the late update would move the camera back to the last detected pose
+		const FTransform viewpoint_pose = CameraAdditionalRotation * ViewpointTransform;
+		ViewpointHistory->Add(time_now, viewpoint_pose, viewpoint_pose, true);
+	}
+
+	for (int32 board_id : LastDetectedBoardIds)
+	{
+		TUniquePtr<TrackedBoardInfo>* tbi_ptr = TrackedBoardsById.Find(board_id);
+		if (tbi_ptr && !(*tbi_ptr)->UseAsViewpointOrigin)
+		{
+			TrackedBoardInfo* tbi = tbi_ptr->Get();
+			if (time_now - tbi->Motion.Time <= max_time)
 			{
-				const float blend_factor = (1.0 - Settings.SmoothingStrength);
-				FTransform detected_transform(t_mat);
+				tbi->CurrentTransform = tbi->Motion.Predict(time_now);
+				snapshot.Boards.Add({ tbi->Id, tbi->BoardActor, tbi->CurrentTransform, 0.0f, time_now });
+				predicted_any = true;
 
-				if (tbi->UseAsViewpointOrigin)
+				if (tbi->History.IsValid())
 				{
-					
-					if (tbi->BoardActor)
-					{
-						// Transforms are from right to left:
-						// - outer: board actor transform => but board actor in center
-						// - middle: camera transform from AR marker => move from board to camera looking at board
-						// - inner: rotate to look forward 
-						detected_transform *= tbi->BoardActor->GetActorTransform();
-					}
-
-					// Blend the viewport transform
-					ViewpointTransform.BlendWith(detected_transform, blend_factor);
-					ViewpointPoseDetectedOnLastTick = true;
+					const FTransform board_pose = tbi->CurrentTransform.GetRelativeTransformReverse(ViewpointTransform);
+					tbi->History->Add(time_now, board_pose, board_pose, true);
 				}
-				else
-				{
-					// Smoothly merge measured transform with current transform
-					tbi->CurrentTransform.BlendWith(detected_transform, blend_factor);
-					DetectedBoards.Add(tbi);
-				}			
 			}
-			else
+		}
+	}
+
+	PublishPoseSnapshot(time_now, true);
+
+	return predicted_any;
+}
+
+bool FAURArucoTracker::GetFrameViewpointMeasurement(FTransform& out_camera_transform) const
+{
+	if (ViewpointDetectedInFrame)
+	{
+		// rotate so camera looks forward, like in PublishTransformUpdatesOnTick
+		out_camera_transform = CameraAdditionalRotation * ViewpointMeasurementInFrame;
+	}
+	return ViewpointDetectedInFrame;
+}
+
+bool FAURArucoTracker::GetBoardPoseAtTime(int32 board_id, double time, FTransform& out_transform, bool filtered) const
+{
+	TSharedPtr<FAURPoseHistory, ESPMode::ThreadSafe> history;
+	{
+		FRWScopeLock lock(PoseHistoriesLock, SLT_ReadOnly);
+		FAURPoseHistoryRef const* found = PoseHistories.Find(board_id);
+		if (found)
+		{
+			history = *found;
+		}
+	}
+
+	// The history stays valid while held, even if the board is removed meanwhile
+	return history.IsValid() && history->GetPoseAtTime(time, Settings.MaxPredictionTime, out_transform, filtered);
+}
+
+bool FAURArucoTracker::GetViewpointPoseAtTime(double time, FTransform& out_transform, bool filtered) const
+{
+	return ViewpointHistory->GetPoseAtTime(time, Settings.MaxPredictionTime, out_transform, filtered);
+}
+
+void FAURArucoTracker::GetLateUpdateBoards(TArray<FLateUpdateBoard>& out_boards) const
+{
+	FRWScopeLock lock(PoseHistoriesLock, SLT_ReadOnly);
+
+	for (FRegisteredBoard const& reg : RegisteredBoards)
+	{
+		if (reg.bPublished && !reg.UseAsViewpointOrigin && reg.BoardActor
+			&& reg.BoardActor->bLateUpdateActorToMove && reg.BoardActor->ActorToMove)
+		{
+			const int32 board_id = reg.BoardActor->GetPatternDefinition()->getMinMarkerId();
+
+			// The history appears once the detection thread has added the board
+			FAURPoseHistoryRef const* history = PoseHistories.Find(board_id);
+			if (history)
 			{
-				UE_LOG(LogAUR, Warning, TEXT("Wrong transform matrix %s"), *t_mat.ToString());
+				out_boards.Add({ board_id, reg.BoardActor->ActorToMove, *history });
 			}
 		}
 	}
+}
 
-	return true;
+void FAURArucoTracker::SetViewpointTransform(FTransform const& camera_transform)
+{
+	PublishedViewpointTransform = CameraAdditionalRotation.Inverse() * camera_transform;
 }
 
-void FAURArucoTracker::PublishTransformUpdate(TrackedBoardInfo * tracking_info)
+void FAURArucoTracker::PublishTransformUpdate(FBoardMeasurement const& measurement, FAURPoseBatch& out_batch)
 {
-	auto board_actor = tracking_info->BoardActor;
+	auto board_actor = measurement.BoardActor;
+
+	// Skip boards which were unregistered after this measurement was made
+	FRegisteredBoard* reg = RegisteredBoards.FindByPredicate([&](FRegisteredBoard const& registered) {
+		return registered.BoardActor == board_actor;
+	});
 
-	if (board_actor)
+	if (board_actor && reg)
 	{
 		// Transforms measured by the tracker = positions of the camera looking at the board:
 		// transform_tracker_viewpoint = camera pos 1
@@ -157,9 +554,21 @@ void FAURArucoTracker::PublishTransformUpdate(TrackedBoardInfo * tracking_info)
 
 		// "GetRelativeTransformReverse returns this(-1)*Other, and parameter is Other."
 
-		board_actor->TransformMeasured(
-			tracking_info->CurrentTransform.GetRelativeTransformReverse(ViewpointTransform)
-		);
+		const FTransform board_transform = measurement.Transform.GetRelativeTransformReverse(PublishedViewpointTransform);
+
+		// Skip poses which did not change noticeably, unless the board was never published
+		if (reg->bPublished
+			&& FVector::Dist(board_transform.GetLocation(), reg->PublishedTransform.GetLocation()) < Settings.PublishMinTranslation
+			&& FMath::RadiansToDegrees(board_transform.GetRotation().AngularDistance(reg->PublishedTransform.GetRotation())) < Settings.PublishMinRotation)
+		{
+			return;
+		}
+
+		reg->PublishedTransform = board_transform;
+		reg->bPublished = true;
+
+		board_actor->TransformMeasured(board_transform);
+		out_batch.Add(measurement.BoardId, board_actor, board_transform, measurement.Quality, measurement.Time);
 	}
 }
 
@@ -171,34 +580,122 @@ bool FAURArucoTracker::RegisterBoard(AAURFiducialPattern* board_actor, bool use_
 		return false;
 	}
 
+	if (RegisteredBoards.ContainsByPredicate([&](FRegisteredBoard const& reg) { return reg.BoardActor == board_actor; }))
+	{
+		UE_LOG(LogAUR, Warning, TEXT("AURArucoTracker::RegisterBoard %s is already registered"), *AActor::GetDebugName(board_actor));
+		return false;
+	}
+
+	cv::Ptr<cv::aur::FiducialPattern> pattern = board_actor->GetPatternDefinition();
+	if (!pattern)
+	{
+		UE_LOG(LogAUR, Error, TEXT("AURArucoTracker::RegisterBoard %s has no pattern"), *AActor::GetDebugName(board_actor));
+		return false;
+	}
+
+	if (!CanAddPattern(pattern, board_actor))
+	{
+		return false;
+	}
+
 	// Save marker images
 	board_actor->SaveMarkerFiles();
 
 	UE_LOG(LogAUR, Log, TEXT("AURArucoTracker::RegisterBoard %s"), *AActor::GetDebugName(board_actor));
-	cv::aur::TrackedPose* pose_handle = TrackerModule.registerPoseToTrack(board_actor->GetPatternDefinition());
 
-	if(!pose_handle)
+	const FTransform actor_transform = board_actor->GetActorTransform();
+	RegisteredBoards.Add({ board_actor, use_as_viewpoint_origin, actor_transform, FTransform::Identity, false, pattern });
+
+	Commands.Enqueue([this, board_actor, pattern, use_as_viewpoint_origin, actor_transform]() {
+		AddBoardToModule(board_actor, pattern, use_as_viewpoint_origin, actor_transform);
+	});
+
+	board_actor->SetActorHiddenInGame(!BoardVisibility);
+
+	return true;
+}
+
+bool FAURArucoTracker::CanAddPattern(cv::Ptr<cv::aur::FiducialPattern> const& pattern, AAURFiducialPattern* board_actor) const
+{
+	// The first board chooses the dictionary
+	if (RegisteredBoards.Num() == 0)
 	{
+		return true;
+	}
+
+	const int32 dictionary_id = RegisteredBoards[0].Pattern->getArucoDictionaryId();
+	if (pattern->getArucoDictionaryId() != dictionary_id)
+	{
+		UE_LOG(LogAUR, Error, TEXT("AURArucoTracker::RegisterBoard %s uses dictionary %d but the registered boards use dictionary %d"),
+			*AActor::GetDebugName(board_actor), pattern->getArucoDictionaryId(), dictionary_id);
 		return false;
 	}
 
+	for (FRegisteredBoard const& reg : RegisteredBoards)
+	{
+		std::vector<int> const& registered_ids = reg.Pattern->getMarkerIds();
+		for (int marker_id : pattern->getMarkerIds())
+		{
+			if (std::find(registered_ids.begin(), registered_ids.end(), marker_id) != registered_ids.end())
+			{
+				UE_LOG(LogAUR, Error, TEXT("AURArucoTracker::RegisterBoard %s contains marker %d which is already used by %s"),
+					*AActor::GetDebugName(board_actor), marker_id, *AActor::GetDebugName(reg.BoardActor));
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void FAURArucoTracker::AddBoardToModule(AAURFiducialPattern* board_actor, cv::Ptr<cv::aur::FiducialPattern> pattern, bool use_as_viewpoint_origin, FTransform const& actor_transform)
+{
+	cv::aur::TrackedPose* pose_handle = TrackerModule.registerPoseToTrack(pattern);
+
+	// Checked by CanAddPattern already, the module logs the reason
+	if(!pose_handle)
+	{
+		return;
+	}
+
 	// Construct and add to map
 	TrackedBoardInfo* tracker_info = new TrackedBoardInfo(board_actor, pose_handle);
 	pose_handle->userObject = tracker_info;
 	tracker_info->UseAsViewpointOrigin = use_as_viewpoint_origin;
+	tracker_info->BoardActorTransform = actor_transform;
 
 	// keep the shared ptr here
 	TrackedBoardsById.Emplace(tracker_info->Id, tracker_info);
 
-	board_actor->SetActorHiddenInGame(!BoardVisibility);
+	if (!use_as_viewpoint_origin)
+	{
+		FAURPoseHistoryRef history = MakeShared<FAURPoseHistory, ESPMode::ThreadSafe>();
+		tracker_info->History = history;
 
-	return true;
+		FRWScopeLock lock(PoseHistoriesLock, SLT_Write);
+		PoseHistories.Add(tracker_info->Id, history);
+	}
 }
 
 void FAURArucoTracker::UnregisterBoard(AAURFiducialPattern* board_actor)
 {
-	int board_id = board_actor->GetPatternDefinition()->getMinMarkerId();
+	const int32 num_removed = RegisteredBoards.RemoveAll([&](FRegisteredBoard const& reg) { return reg.BoardActor == board_actor; });
+
+	if (num_removed == 0)
+	{
+		UE_LOG(LogAUR, Error, TEXT("AURArucoTracker::UnregisterBoard %s is not registered"), *AActor::GetDebugName(board_actor));
+		return;
+	}
 
+	const int32 board_id = board_actor->GetPatternDefinition()->getMinMarkerId();
+
+	Commands.Enqueue([this, board_id]() {
+		RemoveBoardFromModule(board_id);
+	});
+}
+
+void FAURArucoTracker::RemoveBoardFromModule(int32 board_id)
+{
 	if (!TrackedBoardsById.Contains(board_id))
 	{
 		UE_LOG(LogAUR, Error, TEXT("AURArucoTracker::UnregisterBoard Board with id %d is not registered"),
@@ -213,36 +710,74 @@ void FAURArucoTracker::UnregisterBoard(AAURFiducialPattern* board_actor)
 		tracking_info->PoseHandle->unregister();
 	}
 
-	// Since this object will be deleted, remove it from being potentially used in Publish
-	DetectedBoards.Remove(tracking_info);
-
 	// Remove the unique ptr and also delete object
 	TrackedBoardsById.Remove(board_id);
+
+	{
+		FRWScopeLock lock(PoseHistoriesLock, SLT_Write);
+		PoseHistories.Remove(board_id);
+	}
+}
+
+void FAURArucoTracker::SendBoardActorTransforms()
+{
+	for (FRegisteredBoard& reg : RegisteredBoards)
+	{
+		// Only the viewpoint origins use the actor transform
+		if (reg.UseAsViewpointOrigin && reg.BoardActor)
+		{
+			const FTransform actor_transform = reg.BoardActor->GetActorTransform();
+
+			if (!actor_transform.Equals(reg.SentActorTransform))
+			{
+				reg.SentActorTransform = actor_transform;
+
+				const int32 board_id = reg.BoardActor->GetPatternDefinition()->getMinMarkerId();
+				Commands.Enqueue([this, board_id, actor_transform]() {
+					TUniquePtr<TrackedBoardInfo>* tbi = TrackedBoardsById.Find(board_id);
+					if (tbi)
+					{
+						(*tbi)->BoardActorTransform = actor_transform;
+					}
+				});
+			}
+		}
+	}
 }
 
-void FAURArucoTracker::PublishTransformUpdatesOnTick(UAURDriver* driver_instance)
+void FAURArucoTracker::PublishTransformUpdatesOnTick(UAURDriver* driver_instance, FAURPoseBatch& out_batch, bool publish_viewpoint)
 {
-	FScopeLock lock(&PoseLock);
+	SendBoardActorTransforms();
 
-	if (ViewpointPoseDetectedOnLastTick)
+	// Nothing new since the last tick
+	if (!PoseSnapshots.IsDirty())
 	{
+		return;
+	}
+
+	// The read buffer belongs to this thread until the next swap, the callbacks below can take their time
+	PoseSnapshots.SwapReadBuffers();
+	FPoseSnapshot const& snapshot = PoseSnapshots.Read();
+
+	// Otherwise the caller provides the viewpoint through SetViewpointTransform
+	if (publish_viewpoint && snapshot.ViewpointSequence != PublishedViewpointSequence)
+	{
+		PublishedViewpointSequence = snapshot.ViewpointSequence;
+		PublishedViewpointTransform = snapshot.ViewpointTransform;
+
 		if (driver_instance)
 		{
 			driver_instance->OnViewpointTransformUpdate.Broadcast(
-				driver_instance, 
-				CameraAdditionalRotation * ViewpointTransform // rotate so camera looks forward
+				driver_instance,
+				CameraAdditionalRotation * PublishedViewpointTransform // rotate so camera looks forward
 			);
 		}
-
-		ViewpointPoseDetectedOnLastTick = false;
 	}
 
-	for (auto detected_board_info : DetectedBoards)
+	for (auto const& measurement : snapshot.Boards)
 	{
-		PublishTransformUpdate(detected_board_info);
+		PublishTransformUpdate(measurement, out_batch);
 	}
-
-	DetectedBoards.Empty();
 }
 
 void FAURArucoTracker::SetDiagnosticInfoLevel(EAURDiagnosticInfoLevel NewLevel)
@@ -260,15 +795,17 @@ void FAURArucoTracker::SetDiagnosticInfoLevel(EAURDiagnosticInfoLevel NewLevel)
 	if(NewLevel == EAURDiagnosticInfoLevel::AURD_Basic) lvl = cv::aur::DiagnosticLevel::Basic;
 	else if (NewLevel == EAURDiagnosticInfoLevel::AURD_Advanced) lvl = cv::aur::DiagnosticLevel::Full;
 
-	TrackerModule.setDiagnosticLevel(lvl);
+	Commands.Enqueue([this, lvl]() {
+		TrackerModule.setDiagnosticLevel(lvl);
+	});
 }
 
 void FAURArucoTracker::SetBoardVisibility(bool NewBoardVisibility)
 {
 	BoardVisibility = NewBoardVisibility;
 
-	for (auto& bi : TrackedBoardsById)
+	for (auto const& reg : RegisteredBoards)
 	{
-		bi.Value->BoardActor->SetActorHiddenInGame(!BoardVisibility);
+		reg.BoardActor->SetActorHiddenInGame(!BoardVisibility);
 	}
 }
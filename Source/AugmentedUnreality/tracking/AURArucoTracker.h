@@ -19,7 +19,10 @@ limitations under the License.
 #include "../AUROpenCVCalibration.h"
 #include "../AUROpenCV.h"
 #include "AURFiducialPattern.h"
+#include "AURPoseHistory.h"
 #include "../AURDriver.h"
+#include "Containers/Queue.h"
+#include "Containers/TripleBuffer.h"
 
 #include "AURArucoTracker.generated.h"
 
@@ -39,9 +42,39 @@ struct FArucoTrackerSettings
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
 	float SmoothingStrength;
 
+	// On frames without detection poses are extrapolated from their velocity, at most this long (seconds) after the last detection
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float MaxPredictionTime;
+
+	// Reuse the last detection while the image around the detected boards does not change, for static cameras
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bReuseStaticDetections;
+
+	// Fraction of the area around the boards which has to change to run detection again
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", ClampMax = "1.0", UIMin = "0.0", UIMax = "1.0"))
+	float StaticChangeThreshold;
+
+	// Detection runs at least on every N-th frame even if nothing changed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "1", UIMin = "1"))
+	int32 StaticRefreshInterval;
+
+	// Board poses which moved less than this (units) and rotated less than PublishMinRotation since they were last published are not published again
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float PublishMinTranslation;
+
+	// Degrees
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality, meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float PublishMinRotation;
+
 	FArucoTrackerSettings()
 		: TranslationScale(1.0)
 		, SmoothingStrength(0.5)
+		, MaxPredictionTime(0.25)
+		, bReuseStaticDetections(false)
+		, StaticChangeThreshold(0.01)
+		, StaticRefreshInterval(30)
+		, PublishMinTranslation(0.01)
+		, PublishMinRotation(0.05)
 	{
 	}
 };
@@ -54,6 +87,31 @@ class FAURArucoTracker
 {
 public:
 
+	// Constant velocity model of a tracked pose
+	struct FMotionState
+	{
+		FTransform Transform;
+		double Time;
+		FVector LinearVelocity;
+		// Rotation axis scaled by angular speed (rad/s)
+		FVector AngularVelocity;
+		bool bHasTransform;
+		bool bHasVelocity;
+
+		FMotionState()
+			: Transform(FTransform::Identity)
+			, Time(0)
+			, LinearVelocity(0, 0, 0)
+			, AngularVelocity(0, 0, 0)
+			, bHasTransform(false)
+			, bHasVelocity(false)
+		{
+		}
+
+		void Update(FTransform const& transform, double time);
+		FTransform Predict(double time) const;
+	};
+
 	struct TrackedBoardInfo {
 		// Tracked boards are identified by the lowest ID of their markers (marker IDs are unique)
 		int32 Id;
@@ -66,12 +124,21 @@ public:
 		//
 		bool UseAsViewpointOrigin;
 
+		// Copy of the actor's transform sent by the game thread, the actor itself is not read by the detection thread
+		FTransform BoardActorTransform;
+
+		FMotionState Motion;
+
+		// Measurements for GetBoardPoseAtTime, not kept for viewpoint origins
+		TSharedPtr<FAURPoseHistory, ESPMode::ThreadSafe> History;
+
 		TrackedBoardInfo(AAURFiducialPattern* board_actor, cv::aur::TrackedPose* pose)
 			: Id(pose->getPoseId())
 			, BoardActor(board_actor)
 			, PoseHandle(pose)
 			, CurrentTransform(FTransform::Identity)
 			, UseAsViewpointOrigin(false)
+			, BoardActorTransform(FTransform::Identity)
 		{
 		}
 	};
@@ -87,29 +154,157 @@ public:
 
 	void SetCameraProperties(FOpenCVCameraProperties const& camera_properties);
 
-	// Returns the position of the camera (but with Z axis pointing toward the markers)
-	FTransform const& GetViewpointTransform() const
+	// Returns the position of the camera as last published by PublishTransformUpdatesOnTick, game thread only
+	FTransform GetViewpointTransform() const
 	{
-		return ViewpointTransformCamera;
+		return CameraAdditionalRotation * PublishedViewpointTransform;
 	}
 
 	/*
 		Calculate camera's position/rotation relative to the markers
 		Returns true if any markers were detected
 	*/
-	bool DetectMarkers(cv::Mat_<cv::Vec3b>& image, bool draw_found_markers = false);
+	bool DetectMarkers(cv::Mat_<cv::Vec3b> const& image, bool draw_found_markers = false);
+
+	// Same as above, with the grey version of the image already computed by the caller
+	bool DetectMarkers(cv::Mat_<cv::Vec3b> const& image, cv::Mat_<uint8> const& image_grey);
+
+	/*
+		Append the markers and board axes found by the last detection, at the advanced diagnostic level.
+		Coordinates are relative to the size of the detection image. Detection thread only.
+	*/
+	void GetFrameOverlay(FAURFrameOverlay& out_overlay) const;
+
+	/*
+		Chessboard corners of the ChArUco board with the most corners, found by the last DetectMarkers call
+		even if the board's pose could not be solved, for calibration without a second detection.
+		Returns false if no ChArUco board was found
+		or the previous detection was reused. Detection thread only.
+	*/
+	bool GetFrameChessboardCorners(std::vector<cv::Point2f>& out_corners, std::vector<int>& out_ids,
+		cv::Ptr<cv::aruco::CharucoBoard>& out_board) const;
+
+	// Interpolate ChArUco corners with the camera model, disabled while the camera is calibrated. Applied before the next frame.
+	void SetUseCameraModelForCorners(bool use_camera_model);
+
+	// Time assigned to the poses measured by the next DetectMarkers call instead of the current time, for reproducible runs
+	void SetNextFrameTime(double frame_time)
+	{
+		NextFrameTime = frame_time;
+	}
+
+	/*
+		Instead of detection, extrapolate the poses of the boards detected last time
+		and publish them as if they were measured. Returns false if there was nothing to predict.
+	*/
+	bool PredictPoses(double time_now);
+
+	// Highest speed (units/s) of a board or the viewpoint at the last detection, detection thread only
+	float GetMaxPoseSpeed() const
+	{
+		return MaxPoseSpeed;
+	}
+
+	// Highest rotation speed (degrees/s) of a board or the viewpoint at the last detection, detection thread only
+	float GetMaxRotationSpeed() const
+	{
+		return MaxRotationSpeed;
+	}
+
+	// Time when a board detected before was missing in a frame, detection thread only
+	double GetLastBoardLossTime() const
+	{
+		return LastBoardLossTime;
+	}
+
+	/*
+		Unsmoothed viewpoint measured in the last DetectMarkers call, in the same convention as GetViewpointTransform.
+		Returns false if no viewpoint board was detected in that frame.
+		Only valid on the thread which calls DetectMarkers.
+	*/
+	bool GetFrameViewpointMeasurement(FTransform& out_camera_transform) const;
+
+	// Unsmoothed pose of a board measured in one frame
+	struct FFrameBoardMeasurement
+	{
+		int32 BoardId;
+		// Board relative to the camera: the board's world transform is Transform * camera transform
+		FTransform Transform;
+		// Fraction of the board's markers seen
+		float Quality;
+	};
+
+	/*
+		Boards other than viewpoint origins measured in the last DetectMarkers call.
+		Only valid on the thread which calls DetectMarkers.
+	*/
+	void GetFrameBoardMeasurements(TArray<FFrameBoardMeasurement>& out_measurements) const
+	{
+		out_measurements = BoardMeasurementsInFrame;
+	}
+
+	/*
+		Pose of a board at the given frame time (FPlatformTime::Seconds() or the simulated clock),
+		relative to the viewpoint like the transforms given to AAURFiducialPattern::TransformMeasured.
+		Interpolated between the measurements around that time, extrapolated at most MaxPredictionTime after the last one.
+		filtered: smoothed as published, otherwise as measured in the frame.
+		Any thread. Returns false if the board was not measured or time is before its kept history.
+	*/
+	bool GetBoardPoseAtTime(int32 board_id, double time, FTransform& out_transform, bool filtered = true) const;
+
+	// Camera pose at the given frame time, in the convention of GetViewpointTransform. Any thread.
+	bool GetViewpointPoseAtTime(double time, FTransform& out_transform, bool filtered = true) const;
+
+	// Samples of the viewpoint, the same as used by GetViewpointPoseAtTime
+	FAURPoseHistoryRef GetViewpointHistory() const
+	{
+		return ViewpointHistory;
+	}
+
+	// Board whose ActorToMove is moved again at render time, see AAURFiducialPattern::bLateUpdateActorToMove
+	struct FLateUpdateBoard
+	{
+		int32 BoardId;
+		AActor* Actor;
+		TSharedPtr<FAURPoseHistory, ESPMode::ThreadSafe> History;
+	};
 
-	// Start tracking a board
+	// Boards already published to their ActorToMove which asked for a late update. Game thread only.
+	void GetLateUpdateBoards(TArray<FLateUpdateBoard>& out_boards) const;
+
+	/*
+		Overrides the current viewpoint, for example with a pose fused from several cameras.
+		Boards are published relative to this viewpoint. Game thread only,
+		use with PublishTransformUpdatesOnTick(driver, false) so that the measured viewpoint does not replace it.
+	*/
+	void SetViewpointTransform(FTransform const& camera_transform);
+
+	/*
+		Start tracking a board. Called from the game thread,
+		the tracker is updated before the next frame is processed.
+	*/
 	bool RegisterBoard(AAURFiducialPattern* board_actor, bool use_as_viewpoint_origin = false);
 
-	// Stop tracking a board
+	// Stop tracking a board, also applied before the next frame
 	void UnregisterBoard(AAURFiducialPattern* board_actor);
 
 	/*
-		Tell the board actors about newly detected positions.
-		Should run in game thread.
+		Send the transforms of viewpoint origin boards to the detection thread if the actors moved.
+		Called by PublishTransformUpdatesOnTick, game thread only.
 	*/
-	void PublishTransformUpdatesOnTick(UAURDriver* driver_instance);
+	void SendBoardActorTransforms();
+
+	/*
+		Tell the board actors about newly detected positions and append them to out_batch.
+		Should run in game thread. Reads the newest pose snapshot without waiting for the detection thread.
+	*/
+	void PublishTransformUpdatesOnTick(UAURDriver* driver_instance, FAURPoseBatch& out_batch, bool publish_viewpoint = true);
+
+	// Thread safe, the listener is called on the detection thread from the next frame on
+	void AddPoseListener(FAURPoseListenerRef const& listener);
+
+	// Thread safe, but a call which already started on the detection thread may still be running
+	void RemovePoseListener(FAURPoseListenerRef const& listener);
 
 	void SetDiagnosticInfoLevel(EAURDiagnosticInfoLevel NewLevel);
 	void SetBoardVisibility(bool NewBoardVisibility);
@@ -121,22 +316,128 @@ private:
 
 	bool BoardVisibility;
 
-	FCriticalSection PoseLock;
+	/*
+		Changes to TrackerModule and TrackedBoardsById requested by other threads.
+		They are applied by the detection thread between frames,
+		so detection never sees a half-made change and does not lock anything while processing a frame.
+	*/
+	TQueue<TFunction<void()>, EQueueMode::Mpsc> Commands;
 
 	// Marker information
-	// Collection of all boards to track
+	// Collection of all boards to track, used only by the detection thread
 	TMap<int, TUniquePtr<TrackedBoardInfo>> TrackedBoardsById;
 
-	// Set of boards for which a new position was measured
-	TArray<TrackedBoardInfo*> DetectedBoards;
-	bool ViewpointPoseDetectedOnLastTick;
+	// Boards registered from the game thread, used only by the game thread
+	struct FRegisteredBoard
+	{
+		AAURFiducialPattern* BoardActor;
+		bool UseAsViewpointOrigin;
+		// Last actor transform sent to the detection thread
+		FTransform SentActorTransform;
+		// Last transform published to the actor, poses close to it are skipped
+		FTransform PublishedTransform;
+		bool bPublished;
+		// Pattern given to the detection thread
+		cv::Ptr<cv::aur::FiducialPattern> Pattern;
+	};
+	TArray<FRegisteredBoard> RegisteredBoards;
+
+	/*
+		Same checks as cv::aur::FiducialTracker::registerPoseToTrack against the registered boards,
+		which the detection thread has or will have added, so that RegisterBoard can fail on the game thread.
+	*/
+	bool CanAddPattern(cv::Ptr<cv::aur::FiducialPattern> const& pattern, AAURFiducialPattern* board_actor) const;
+
+	// Boards for which a new position was measured
+	struct FBoardMeasurement
+	{
+		int32 BoardId;
+		AAURFiducialPattern* BoardActor;
+		FTransform Transform;
+		// Fraction of the board's markers seen, 0 if predicted
+		float Quality;
+		double Time;
+	};
+
+	// Poses resulting from one frame
+	struct FPoseSnapshot
+	{
+		// Changes whenever the viewpoint is measured or predicted
+		int64 ViewpointSequence;
+		FTransform ViewpointTransform;
+		TArray<FBoardMeasurement> Boards;
+
+		FPoseSnapshot()
+			: ViewpointSequence(0)
+			, ViewpointTransform(FTransform::Identity)
+		{
+		}
+	};
 
+	/*
+		The detection thread fills the write buffer and publishes it by swapping a buffer index,
+		the game thread swaps in the newest snapshot and reads it. Neither waits for the other,
+		snapshots published between two ticks are replaced by the newest one.
+	*/
+	TTripleBuffer<FPoseSnapshot> PoseSnapshots;
+
+	// Detection thread side of FPoseSnapshot::ViewpointSequence
+	int64 ViewpointSequence;
+
+	// Histories of TrackedBoardInfo::History by board ID, the map is changed by the detection thread
+	mutable FRWLock PoseHistoriesLock;
+	TMap<int32, FAURPoseHistoryRef> PoseHistories;
+	FAURPoseHistoryRef ViewpointHistory;
+
+	// Native subscribers called on the detection thread
+	FCriticalSection PoseListenersLock;
+	TArray<FAURPoseListenerRef> PoseListeners;
+
+	// Detection thread: frames given to UpdateDetectedPoses / PredictPoses, and the viewpoint sequence the listeners have seen
+	int64 ProcessedFrameCount;
+	int64 NotifiedViewpointSequence;
+
+	// Game thread: viewpoint relative to which boards are published, and the snapshot it came from
+	FTransform PublishedViewpointTransform;
+	int64 PublishedViewpointSequence;
+
+	// Raw measurements from the last frame, written and read by the detection thread
+	bool ViewpointDetectedInFrame;
+	FTransform ViewpointMeasurementInFrame;
+	TArray<FFrameBoardMeasurement> BoardMeasurementsInFrame;
+
+	// Motion model state, detection thread only
+	FMotionState ViewpointMotion;
+	bool ViewpointDetectedOnLastDetection;
+	TArray<int32> LastDetectedBoardIds;
+	float MaxPoseSpeed;
+	float MaxRotationSpeed;
+	double LastBoardLossTime;
+	// Negative if the current time is used
+	double NextFrameTime;
+
+	// Smoothed viewpoint, detection thread only
 	FTransform ViewpointTransform;
-	FTransform ViewpointTransformCamera;
 
 	FOpenCVCameraProperties CameraProperties;
 
-	void PublishTransformUpdate(TrackedBoardInfo* tracking_info);
+	void PublishTransformUpdate(FBoardMeasurement const& measurement, FAURPoseBatch& out_batch);
+
+	// Read the poses found by TrackerModule in the current frame
+	bool UpdateDetectedPoses();
+
+	// Complete the write buffer of PoseSnapshots with the viewpoint, give it to the pose listeners and hand it to the game thread
+	void PublishPoseSnapshot(double frame_time, bool predicted);
+
+	// Detection thread side of PublishPoseSnapshot
+	void NotifyPoseListeners(FPoseSnapshot const& snapshot, double frame_time, bool predicted);
+
+	// Run the commands queued by other threads, called by the detection thread before each frame
+	void ApplyCommands();
+
+	// Detection thread side of RegisterBoard / UnregisterBoard
+	void AddBoardToModule(AAURFiducialPattern* board_actor, cv::Ptr<cv::aur::FiducialPattern> pattern, bool use_as_viewpoint_origin, FTransform const& actor_transform);
+	void RemoveBoardFromModule(int32 board_id);
 
 	/*
 	OpenCV's rotation is
@@ -24,7 +24,9 @@ AAURFiducialPattern::AAURFiducialPattern()
 	: PatternFileDir("AugmentedUnreality/Patterns")
 	, PredefinedDictionaryId(cv::aruco::DICT_4X4_100)
 	, AutomaticallyUseForCameraPose(true)
+	, bBroadcastTransformUpdates(false)
 	, ActorToMove(nullptr)
+	, bLateUpdateActorToMove(false)
 {
 	PrimaryActorTick.bStartWithTickEnabled = false;
 	SetActorTickEnabled(false);
@@ -90,7 +92,10 @@ void AAURFiducialPattern::TransformMeasured(FTransform const & new_transform)
 		ActorToMove->SetActorTransform(new_transform, false);
 	}
 
-	OnTransformUpdate.Broadcast(new_transform);
+	if (bBroadcastTransformUpdates)
+	{
+		OnTransformUpdate.Broadcast(new_transform);
+	}
 }
 
 cv::Ptr< cv::aruco::Dictionary > AAURFiducialPattern::GetArucoDictionary() const
@@ -64,15 +64,31 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ArucoTracking)
 	bool AutomaticallyUseForCameraPose;
 
-	// Event fired when this board is detected by the tracker and provides the location of the board.
+	// Event fired when this board is detected by the tracker and provides the location of the board, if bBroadcastTransformUpdates is set.
 	UPROPERTY(BlueprintAssignable, Category = AugmentedReality)
 	FAURFiducialTransformUpdate OnTransformUpdate;
 
+	/*
+		Fire OnTransformUpdate for this board.
+		Off by default, with many boards UAURDriver::OnPoseBatchUpdate delivers all poses with one event per tick.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = AugmentedReality)
+	bool bBroadcastTransformUpdates;
+
 	// This actor will be moved to match the detected position of this board.
 	// Or if this was registered with use_as_viewpoint_origin, it will be placed in the determined camera position.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ArucoTracking)
 	AActor* ActorToMove;
 
+	/*
+		With UAURDriverOpenCV::LateUpdate enabled, ActorToMove is rendered at the newest pose
+		read just before rendering instead of the one set on the game thread's tick.
+		When detection is skipped for a frame, that pose is predicted from the board's motion.
+		Only the rendered primitives move, collision and game logic see the tick's transform.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = ArucoTracking)
+	bool bLateUpdateActorToMove;
+
 	/**
 		Save all markers to image files.
 		By default saves to FPaths::GameSavedDir()/this->MarkerFileDir/this->GetName()
@@ -0,0 +1,159 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "AURPoseHistory.h"
+
+// A reader gives up if the slot keeps being rewritten, only possible if it is the oldest one
+static const int32 MAX_READ_ATTEMPTS = 4;
+
+FAURPoseHistory::FAURPoseHistory()
+	: NumWritten(0)
+{
+}
+
+void FAURPoseHistory::Add(double time, FTransform const& raw, FTransform const& filtered, bool predicted)
+{
+	const int64 index = NumWritten.Load();
+	FSlot& slot = Slots[index % CAPACITY];
+
+	// Odd while writing
+	slot.Sequence.Store(slot.Sequence.Load() + 1);
+	FPlatformMisc::MemoryBarrier();
+
+	slot.Sample.Index = index;
+	slot.Sample.Time = time;
+	slot.Sample.Raw = raw;
+	slot.Sample.Filtered = filtered;
+	slot.Sample.bPredicted = predicted;
+
+	slot.Sequence.Store(slot.Sequence.Load() + 1);
+
+	NumWritten.Store(index + 1);
+}
+
+bool FAURPoseHistory::ReadSample(int64 index, FSample& out_sample) const
+{
+	FSlot const& slot = Slots[index % CAPACITY];
+
+	for (int32 attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++)
+	{
+		const uint32 sequence_before = slot.Sequence.Load();
+		if (sequence_before & 1)
+		{
+			continue;
+		}
+
+		out_sample = slot.Sample;
+		FPlatformMisc::MemoryBarrier();
+
+		if (slot.Sequence.Load() == sequence_before)
+		{
+			// The slot may already hold a newer sample
+			return out_sample.Index == index;
+		}
+	}
+
+	return false;
+}
+
+bool FAURPoseHistory::GetLatestSample(FSample& out_sample) const
+{
+	const int64 num_written = NumWritten.Load();
+	return num_written > 0 && ReadSample(num_written - 1, out_sample);
+}
+
+bool FAURPoseHistory::GetPoseAtTime(double time, double max_extrapolation, FTransform& out_transform, bool filtered) const
+{
+	auto pose_of = [filtered](FSample const& sample) -> FTransform const& {
+		return filtered ? sample.Filtered : sample.Raw;
+	};
+
+	const int64 num_written = NumWritten.Load();
+
+	FSample later;
+	if (num_written <= 0 || !ReadSample(num_written - 1, later))
+	{
+		return false;
+	}
+
+	// After the newest sample - continue the motion between the last two
+	if (time >= later.Time)
+	{
+		FSample earlier;
+		if (num_written < 2 || !ReadSample(num_written - 2, earlier) || later.Time <= earlier.Time)
+		{
+			out_transform = pose_of(later);
+			return true;
+		}
+
+		const double extrapolation = FMath::Min(time - later.Time, FMath::Max(0.0, max_extrapolation));
+		out_transform = Extrapolate(pose_of(earlier), pose_of(later), float(extrapolation / (later.Time - earlier.Time)));
+		return true;
+	}
+
+	// The oldest slot is the next to be written, it is not searched
+	const int64 oldest_index = FMath::Max<int64>(0, num_written - (CAPACITY - 1));
+
+	for (int64 index = num_written - 2; index >= oldest_index; index--)
+	{
+		FSample earlier;
+		if (!ReadSample(index, earlier))
+		{
+			return false;
+		}
+
+		if (earlier.Time <= time)
+		{
+			const double span = later.Time - earlier.Time;
+			const float alpha = span > 0 ? float((time - earlier.Time) / span) : 1.0f;
+			out_transform = Interpolate(pose_of(earlier), pose_of(later), alpha);
+			return true;
+		}
+
+		later = earlier;
+	}
+
+	return false;
+}
+
+FTransform FAURPoseHistory::Interpolate(FTransform const& a, FTransform const& b, float alpha)
+{
+	return FTransform(
+		FQuat::Slerp(a.GetRotation(), b.GetRotation(), alpha),
+		FMath::Lerp(a.GetTranslation(), b.GetTranslation(), alpha),
+		FMath::Lerp(a.GetScale3D(), b.GetScale3D(), alpha)
+	);
+}
+
+FTransform FAURPoseHistory::Extrapolate(FTransform const& previous, FTransform const& latest, float ratio)
+{
+	FQuat rotation_change = latest.GetRotation() * previous.GetRotation().Inverse();
+	// Take the shorter way around
+	if (rotation_change.W < 0)
+	{
+		rotation_change *= -1.0f;
+	}
+
+	FVector axis;
+	float angle;
+	rotation_change.ToAxisAndAngle(axis, angle);
+
+	return FTransform(
+		FQuat(axis, angle * ratio) * latest.GetRotation(),
+		latest.GetTranslation() + (latest.GetTranslation() - previous.GetTranslation()) * ratio,
+		latest.GetScale3D()
+	);
+}
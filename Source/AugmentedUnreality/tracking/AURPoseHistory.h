@@ -0,0 +1,86 @@
+/*
+Copyright 2016-2020 Krzysztof Lis
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http ://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+
+/*
+	Fixed-capacity ring of timestamped poses of one board or of the viewpoint.
+	Written only by the detection thread, read from any thread without locks:
+	each slot has a sequence number which is odd while the slot is written,
+	a reader retries if the number changed during its copy.
+*/
+class FAURPoseHistory
+{
+public:
+	static const int32 CAPACITY = 64;
+
+	struct FSample
+	{
+		// Number of the sample since the history was created
+		int64 Index;
+		double Time;
+		// Measured in the frame
+		FTransform Raw;
+		// After smoothing, as published to the game
+		FTransform Filtered;
+		// Predicted from the motion on a frame without detection, Raw is the same as Filtered
+		bool bPredicted;
+	};
+
+	FAURPoseHistory();
+
+	// Detection thread only, times must not decrease
+	void Add(double time, FTransform const& raw, FTransform const& filtered, bool predicted = false);
+
+	/*
+		Pose at the given time, any thread.
+		Interpolated between the samples around time (lerp of translation, slerp of rotation),
+		after the newest sample extrapolated from the last two, at most max_extrapolation seconds.
+		Returns false if there are no samples or time is before the oldest kept sample.
+	*/
+	bool GetPoseAtTime(double time, double max_extrapolation, FTransform& out_transform, bool filtered = true) const;
+
+	// Any thread, returns false if there are no samples
+	bool GetLatestSample(FSample& out_sample) const;
+
+protected:
+	struct FSlot
+	{
+		TAtomic<uint32> Sequence;
+		FSample Sample;
+
+		FSlot()
+			: Sequence(0)
+		{
+		}
+	};
+
+	FSlot Slots[CAPACITY];
+
+	// Number of samples written so far
+	TAtomic<int64> NumWritten;
+
+	// Copy the sample with this index, false if it was already overwritten
+	bool ReadSample(int64 index, FSample& out_sample) const;
+
+	static FTransform Interpolate(FTransform const& a, FTransform const& b, float alpha);
+	static FTransform Extrapolate(FTransform const& previous, FTransform const& latest, float ratio);
+};
+
+typedef TSharedRef<FAURPoseHistory, ESPMode::ThreadSafe> FAURPoseHistoryRef;
@@ -50,6 +50,7 @@ void FAURVideoConfiguration::SetPriorityFromDesiredResolution(int32 desired_reso
 UAURVideoSource::UAURVideoSource()
 	: PriorityMultiplier(1.0)
 	, bCalibrated(false)
+	, bRealTimePlayback(true)
 {
 }
 
@@ -125,8 +125,18 @@ public:
 
 	static FString ResolutionToString(FIntPoint const& resolution);
 
+	/*
+		If false, sources which replay recorded or generated video return frames immediately
+		instead of waiting for the frame period. Used by the synchronous mode of the driver.
+	*/
+	void SetRealTimePlayback(bool real_time)
+	{
+		bRealTimePlayback = real_time;
+	}
+
 protected:
 	bool bCalibrated;
+	bool bRealTimePlayback;
 
 	FOpenCVCameraProperties CameraProperties;
 
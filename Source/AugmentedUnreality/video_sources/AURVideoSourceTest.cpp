@@ -57,6 +57,9 @@ bool UAURVideoSourceTest::Connect(FAURVideoConfiguration const& configuration)
 		DesiredResolution.Y = 720;
 	}
 
+	// Same sequence of colors after each connection
+	RandomGenerator = cv::RNG();
+
 	return true;
 }
 
@@ -70,8 +73,6 @@ void UAURVideoSourceTest::Disconnect()
 	UE_LOG(LogAUR, Log, TEXT("UAURVideoSourceTest::Disconnect()"));
 }
 
-cv::RNG random_gen;
-
 bool UAURVideoSourceTest::GetNextFrame(cv::Mat_<cv::Vec3b>& frame)
 {
 	if (FramesPerSecond < 0.5)
@@ -79,10 +80,13 @@ bool UAURVideoSourceTest::GetNextFrame(cv::Mat_<cv::Vec3b>& frame)
 		UE_LOG(LogAUR, Error, TEXT("UAURVideoSourceTest: overriding wrong fps %f"), FramesPerSecond);
 		FramesPerSecond = 0.5;
 	}
-	FPlatformProcess::Sleep(1.0 / FramesPerSecond);
+	if (bRealTimePlayback)
+	{
+		FPlatformProcess::Sleep(1.0 / FramesPerSecond);
+	}
 
 	frame.create(DesiredResolution.Y, DesiredResolution.X);
-	frame.setTo(cv::Vec3b(random_gen.uniform(0, 255), random_gen.uniform(0, 255), random_gen.uniform(0, 255)));
+	frame.setTo(cv::Vec3b(RandomGenerator.uniform(0, 255), RandomGenerator.uniform(0, 255), RandomGenerator.uniform(0, 255)));
 
 	return true;
 }
@@ -45,5 +45,9 @@ public:
 	virtual bool GetNextFrame(cv::Mat_<cv::Vec3b>& frame) override;
 	virtual FIntPoint GetResolution() const override;
 	virtual float GetFrequency() const override;
+
+protected:
+	// Each instance has its own generator, several test sources may run on different threads
+	cv::RNG RandomGenerator;
 };
 	
@@ -88,7 +88,10 @@ bool UAURVideoSourceVideoFile::Connect(FAURVideoConfiguration const& configurati
 bool UAURVideoSourceVideoFile::GetNextFrame(cv::Mat_<cv::Vec3b>& frame)
 {
 	// Simulate camera delay by waiting
-	FPlatformProcess::Sleep(Period);
+	if (bRealTimePlayback)
+	{
+		FPlatformProcess::Sleep(Period);
+	}
 
 	bool success = Capture.read(frame);
 
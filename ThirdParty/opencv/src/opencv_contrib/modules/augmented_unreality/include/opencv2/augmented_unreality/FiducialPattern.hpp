@@ -56,6 +56,12 @@ public:
 		return arucoPredefinedDictionaryId;
 	}
 
+	// The chessboard of ChArUco patterns, empty for other patterns
+	virtual cv::Ptr<cv::aruco::CharucoBoard> getCharucoBoard() const
+	{
+		return cv::Ptr<cv::aruco::CharucoBoard>();
+	}
+
 	void setArucoDictionaryId(const int32_t predefined_dictionary_id);
 
 	// Determines the camera pose from information already collected in TrackedPose
@@ -123,6 +129,11 @@ public:
 
 	cv::Mat_<uint8_t> drawPattern();
 
+	virtual cv::Ptr<cv::aruco::CharucoBoard> getCharucoBoard() const override
+	{
+		return boardChArUco;
+	}
+
 	static cv::Ptr<FiducialPatternChArUcoBoard> build(int32_t width, int32_t height, float square_side, float marker_margin = 1.0, int32_t initial_marker_id = 0, int32_t dictionary_id=cv::aruco::DICT_4X4_100);
 
 protected:
@@ -25,6 +25,35 @@ namespace aur {
 class FiducialPattern;
 class TrackedPose;
 
+/*
+	What was found in the last detection, for a diagnostic overlay drawn by the caller.
+	Collected only at DiagnosticLevel::Full - the processed image is never drawn into.
+*/
+struct CV_EXPORTS FrameDiagnostics
+{
+	struct BoardAxes
+	{
+		int32_t poseId;
+		// Board origin and the ends of its X, Y, Z axes projected to the image
+		cv::Point2f origin;
+		cv::Point2f axisEnds[3];
+		// Mean distance (pixels) between the detected and the reprojected corners of the board's markers
+		float reprojectionError;
+	};
+
+	// Size of the image the coordinates refer to
+	cv::Size imageSize;
+
+	std::vector< std::vector< cv::Point2f > > markerCorners;
+	std::vector< int32_t > markerIds;
+	// Corners of the same markers projected with the estimated board pose, empty for markers without a pose
+	std::vector< std::vector< cv::Point2f > > reprojectedCorners;
+
+	std::vector< BoardAxes > boards;
+
+	void clear();
+};
+
 class CV_EXPORTS FiducialTracker
 {
 public:
@@ -35,11 +64,45 @@ public:
 	void setCameraInfo(cv::Mat_<double> const& intrinsic_mat, cv::Mat_<double> const& distortion);
 	void setArucoParameters(cv::aruco::DetectorParameters const& new_params);
 
+	/*
+		ChArUco corners are interpolated with the camera model set by setCameraInfo.
+		Disable while the camera is being calibrated, then local homographies are used instead.
+	*/
+	void setUseCameraModelForCorners(bool use_camera_model);
+
+	/*
+		Reuse the last detection while the image around the detected boards does not change.
+		change_threshold: fraction of the watched area which has to change to trigger detection
+		refresh_interval: detection runs at least every refresh_interval frames
+	*/
+	void setChangeGating(bool enabled, float change_threshold, int32_t refresh_interval);
+
 	TrackedPose* registerPoseToTrack(cv::Ptr<FiducialPattern> pattern);
-	void processFrame(cv::Mat_<cv::Vec3b>& input_image);
+	void processFrame(cv::Mat_<cv::Vec3b> const& input_image);
+	// grey_image is input_image already converted to grey, for callers which need it for other processing too
+	void processFrame(cv::Mat_<cv::Vec3b> const& input_image, cv::Mat_<uint8_t> const& grey_image);
 
 	std::unordered_set< TrackedPose* > const& getDetectedPoses() const;
 
+	// Poses with markers found in the last frame, also those whose transform could not be determined,
+	// for their chessboard corners
+	std::vector< TrackedPose* > const& getFoundPoses() const
+	{
+		return foundPoses;
+	}
+
+	// Detections of the last frame, empty below DiagnosticLevel::Full
+	FrameDiagnostics const& getFrameDiagnostics() const
+	{
+		return frameDiagnostics;
+	}
+
+	// True if the last processFrame reused the previous detection instead of running it
+	bool wasDetectionReused() const
+	{
+		return detectionReused;
+	}
+
 protected:
 	std::unordered_map< int32_t, cv::Ptr<TrackedPose> > posesById;
 	std::unordered_map< int32_t, TrackedPose* > posesByMarker;
@@ -52,8 +115,40 @@ protected:
 
 	DiagnosticLevel diagnosticLvl;
 
+	bool useCameraModelForCorners;
+
+	// Grey image of the current frame, may share data with the caller's image
 	cv::Mat_<uint8_t> imageGrey;
+	// Buffer for the conversion when the caller does not provide the grey image
+	cv::Mat_<uint8_t> convertedGrey;
 	std::unordered_set< TrackedPose* > detectedPoses;
+	std::vector< TrackedPose* > foundPoses;
+	FrameDiagnostics frameDiagnostics;
+
+	// Change gating
+	bool gatingEnabled;
+	float gatingChangeThreshold;
+	int32_t gatingRefreshInterval;
+	int32_t framesSinceDetection;
+	bool detectionReused;
+	// Set when the camera or boards change, so the old detection is not valid
+	bool forceDetection;
+	// Downsampled grey image of the last frame with detection, and of the current frame
+	cv::Mat_<uint8_t> gateReference;
+	cv::Mat_<uint8_t> gateCurrent;
+	cv::Mat_<uint8_t> gateDifference;
+	// Areas around the markers found by the last detection, in gate image pixels
+	std::vector< cv::Rect > gateRegions;
+	// Markers of the last detection, around which the changes are watched
+	std::vector< std::vector< cv::Point2f > > lastMarkerCorners;
+
+	// Returns true if the previous detection can be reused for grey_image
+	bool canReuseDetection(cv::Mat_<uint8_t> const& grey_image);
+	// Remember the current frame and the marker areas for the following frames
+	void updateGateReference();
+
+	// Store the detected markers and project the axes and markers of the detected poses
+	void collectDiagnostics(std::vector< std::vector< cv::Point2f > > const& corners, std::vector< int32_t > const& ids, cv::Size const& image_size);
 
 	void unregisterPose(TrackedPose* pose);
 
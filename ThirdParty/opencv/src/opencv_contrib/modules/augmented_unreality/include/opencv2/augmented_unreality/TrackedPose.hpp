@@ -63,6 +63,34 @@ public:
 		return RotationMatWorldToCam_U;
 	}
 
+	// Number of the pattern's markers found in the last frame in which the pose was determined
+	int32_t getNumFoundMarkers() const
+	{
+		return numFoundMarkers;
+	}
+
+	int32_t getNumPatternMarkers() const
+	{
+		return int32_t(pattern->getMarkerIds().size());
+	}
+
+	cv::Ptr<FiducialPattern> const& getPattern() const
+	{
+		return pattern;
+	}
+
+	// Chessboard corners of a ChArUco pattern interpolated in the last frame in which its markers were found,
+	// also if the transform could not be determined, empty for other patterns. Can be used for calibration without detecting the markers again.
+	std::vector<cv::Point2f> const& getChessboardCorners() const
+	{
+		return chessboardCorners;
+	}
+
+	std::vector<int> const& getChessboardCornerIds() const
+	{
+		return chessboardCornerIds;
+	}
+
 	// Called by FiducialPattern::determinePose, writes detected pose transform
 	void setTransform(cv::Mat_<double> const& rotation_axis_angle, cv::Mat_<double> const& translation);
 
@@ -82,9 +110,14 @@ protected:
 	cv::Mat_<double> TranslationWorldToCam_U;
 	cv::Mat_<double> RotationMatWorldToCam_U;
 
+	int32_t numFoundMarkers;
+
 	std::vector<int> foundMarkerIds;
 	std::vector< std::vector< cv::Point2f >  > foundMarkerCorners;
 
+	std::vector<cv::Point2f> chessboardCorners;
+	std::vector<int> chessboardCornerIds;
+
 	TrackedPose(FiducialTracker* tracker_ptr, cv::Ptr<FiducialPattern> pattern_def);
 	void clearFound();
 	void addFoundMarker(int32_t id, std::vector< cv::Point2f >& detected_corners);
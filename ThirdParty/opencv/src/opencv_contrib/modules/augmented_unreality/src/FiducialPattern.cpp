@@ -104,21 +104,38 @@ bool FiducialPatternChArUcoBoard::determinePose(TrackedPose* pose_info)
 	std::vector<cv::Point2f> charuco_found_corners;
 	std::vector<int> charuco_found_ids;
 
-	int num_corners = cv::aruco::interpolateCornersCharuco(
-		pose_info->foundMarkerCorners, pose_info->foundMarkerIds,
-		tr->imageGrey, boardChArUco,
-		charuco_found_corners, charuco_found_ids,
-		tr->cameraIntrinsicMat, tr->cameraDistortion
-	);
+	// Without a trusted camera model (during calibration) the corners are found with local homographies
+	int num_corners = 0;
+	if(tr->useCameraModelForCorners)
+	{
+		num_corners = cv::aruco::interpolateCornersCharuco(
+			pose_info->foundMarkerCorners, pose_info->foundMarkerIds,
+			tr->imageGrey, boardChArUco,
+			charuco_found_corners, charuco_found_ids,
+			tr->cameraIntrinsicMat, tr->cameraDistortion
+		);
+	}
+	else
+	{
+		num_corners = cv::aruco::interpolateCornersCharuco(
+			pose_info->foundMarkerCorners, pose_info->foundMarkerIds,
+			tr->imageGrey, boardChArUco,
+			charuco_found_corners, charuco_found_ids
+		);
+	}
 	pose_info->clearFound();
 
 	if (num_corners > 0)
 	{
+		// Kept for calibration before solving the pose, which uses the camera model being calibrated
+		pose_info->chessboardCorners.swap(charuco_found_corners);
+		pose_info->chessboardCornerIds.swap(charuco_found_ids);
+
 		// Translation and rotation: transform from camera to world
 		cv::Mat_<double> rotation_axis_angle, translation;
 
 		bool success = cv::aruco::estimatePoseCharucoBoard(
-			charuco_found_corners, charuco_found_ids,
+			pose_info->chessboardCorners, pose_info->chessboardCornerIds,
 			boardChArUco, tr->cameraIntrinsicMat, tr->cameraDistortion,
 			rotation_axis_angle, translation
 		);
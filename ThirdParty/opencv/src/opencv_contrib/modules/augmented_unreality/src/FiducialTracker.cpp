@@ -18,12 +18,37 @@ limitations under the License.
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
 #include <sstream>
+#include <algorithm>
 
 namespace cv {
 namespace aur {
 
+// Gate images are this many times smaller than the frame
+static const int32_t GATE_DOWNSAMPLE = 4;
+// Grey level difference for a gate pixel to count as changed
+static const int32_t GATE_PIXEL_THRESHOLD = 16;
+// Margin added around the markers (gate pixels), so that motion towards them is seen
+static const int32_t GATE_REGION_MARGIN = 8;
+
+void FrameDiagnostics::clear()
+{
+	imageSize = cv::Size();
+	markerCorners.clear();
+	markerIds.clear();
+	reprojectedCorners.clear();
+	boards.clear();
+}
+
 FiducialTracker::FiducialTracker()
 	: arucoParameters(cv::aruco::DetectorParameters::create())
+	, diagnosticLvl(DiagnosticLevel::Silent)
+	, useCameraModelForCorners(true)
+	, gatingEnabled(false)
+	, gatingChangeThreshold(0.01f)
+	, gatingRefreshInterval(30)
+	, framesSinceDetection(0)
+	, detectionReused(false)
+	, forceDetection(true)
 {
 }
 
@@ -34,17 +59,38 @@ FiducialTracker::~FiducialTracker()
 void FiducialTracker::setDiagnosticLevel(DiagnosticLevel new_diag_level)
 {
 	diagnosticLvl = new_diag_level;
+
+	if(diagnosticLvl < DiagnosticLevel::Full)
+	{
+		frameDiagnostics.clear();
+	}
 }
 
 void FiducialTracker::setCameraInfo(cv::Mat_<double> const& intrinsic_mat, cv::Mat_<double> const& distortion)
 {
 	intrinsic_mat.convertTo(cameraIntrinsicMat, CV_64F);
 	distortion.convertTo(cameraDistortion, CV_64F);
+	forceDetection = true;
 }
 
 void FiducialTracker::setArucoParameters(cv::aruco::DetectorParameters const& new_params)
 {
 	*arucoParameters = new_params;
+	forceDetection = true;
+}
+
+void FiducialTracker::setUseCameraModelForCorners(bool use_camera_model)
+{
+	useCameraModelForCorners = use_camera_model;
+	forceDetection = true;
+}
+
+void FiducialTracker::setChangeGating(bool enabled, float change_threshold, int32_t refresh_interval)
+{
+	gatingEnabled = enabled;
+	gatingChangeThreshold = change_threshold;
+	gatingRefreshInterval = std::max(1, refresh_interval);
+	forceDetection = true;
 }
 
 TrackedPose* FiducialTracker::registerPoseToTrack(cv::Ptr<FiducialPattern> pattern)
@@ -85,6 +131,7 @@ TrackedPose* FiducialTracker::registerPoseToTrack(cv::Ptr<FiducialPattern> patte
 
 	// insert the new board
 	posesById.emplace(new_pose->getPoseId(), new_pose);
+	forceDetection = true;
 
 	for(const int32_t marker_id : pattern->getMarkerIds())
 	{
@@ -99,6 +146,7 @@ void FiducialTracker::unregisterPose(TrackedPose* pose)
 	if(pose)
 	{
 		detectedPoses.erase(pose);
+		foundPoses.erase(std::remove(foundPoses.begin(), foundPoses.end(), pose), foundPoses.end());
 
 		for(int32_t marker_id : pose->pattern->getMarkerIds())
 		{
@@ -106,23 +154,44 @@ void FiducialTracker::unregisterPose(TrackedPose* pose)
 		}
 
 		posesById.erase(pose->getPoseId());
+		forceDetection = true;
 	}
 }
 
-void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b>& input_image)
+void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b> const& input_image)
 {
-	// http://docs.opencv.org/3.2.0/db/da9/tutorial_aruco_board_detection.html
+	cv::cvtColor(input_image, convertedGrey, cv::COLOR_BGR2GRAY);
 
-	detectedPoses.clear();
+	processFrame(input_image, convertedGrey);
+}
 
-	cv::cvtColor(input_image, imageGrey, cv::COLOR_BGR2GRAY);
+void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b> const& input_image, cv::Mat_<uint8_t> const& grey_image)
+{
+	// http://docs.opencv.org/3.2.0/db/da9/tutorial_aruco_board_detection.html
+
+	// Shares the data, the patterns read the grey image when refining their detections
+	imageGrey = grey_image;
 
 	// No boards to detect
 	if(posesById.size() <= 0)
 	{
+		detectedPoses.clear();
+		foundPoses.clear();
+		frameDiagnostics.clear();
+		detectionReused = false;
 		return;
 	}
 
+	// Nothing changed around the boards - the previous poses and diagnostics are still valid
+	detectionReused = canReuseDetection(grey_image);
+	if(detectionReused)
+	{
+		return;
+	}
+
+	detectedPoses.clear();
+	foundPoses.clear();
+
 	// Unreal, and specifically its Android build, does not want to compile try-catch
 	// So we will log the exceptions here through the log callback
 	try
@@ -131,12 +200,7 @@ void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b>& input_image)
 		std::vector< int32_t > out_ids;
 
 		// Find squares and corners in the image
-		cv::aruco::detectMarkers(imageGrey, markerDictionary, out_corners, out_ids, arucoParameters);
-
-		if(diagnosticLvl >= DiagnosticLevel::Full)
-		{
-			cv::aruco::drawDetectedMarkers(input_image, out_corners, out_ids);
-		}
+		cv::aruco::detectMarkers(grey_image, markerDictionary, out_corners, out_ids, arucoParameters);
 
 		// Find which boards were detected
 		for(size_t mk_id = 0; mk_id < out_ids.size(); mk_id++)
@@ -149,6 +213,8 @@ void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b>& input_image)
 			}
 		}
 
+		foundPoses.assign(detectedPoses.begin(), detectedPoses.end());
+
 		// Perform PNP for each board and save the transforms
 		for (auto it = detectedPoses.begin(); it != detectedPoses.end();)
 		{
@@ -163,6 +229,17 @@ void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b>& input_image)
 				it = detectedPoses.erase(it); //returns next iterator
 			}
 		}
+
+		if(diagnosticLvl >= DiagnosticLevel::Full)
+		{
+			collectDiagnostics(out_corners, out_ids, input_image.size());
+		}
+
+		if(gatingEnabled)
+		{
+			lastMarkerCorners = out_corners;
+			updateGateReference();
+		}
 	}
 	catch (std::exception& exc)
 	{
@@ -172,6 +249,135 @@ void FiducialTracker::processFrame(cv::Mat_<cv::Vec3b>& input_image)
 	}
 }
 
+bool FiducialTracker::canReuseDetection(cv::Mat_<uint8_t> const& grey_image)
+{
+	if(!gatingEnabled)
+	{
+		return false;
+	}
+
+	cv::resize(grey_image, gateCurrent, cv::Size(), 1.0 / GATE_DOWNSAMPLE, 1.0 / GATE_DOWNSAMPLE, cv::INTER_AREA);
+
+	framesSinceDetection++;
+
+	if(forceDetection || framesSinceDetection >= gatingRefreshInterval || gateReference.size() != gateCurrent.size())
+	{
+		return false;
+	}
+
+	// absdiff and countNonZero are vectorized by OpenCV
+	cv::absdiff(gateCurrent, gateReference, gateDifference);
+	cv::threshold(gateDifference, gateDifference, GATE_PIXEL_THRESHOLD, 255, cv::THRESH_BINARY);
+
+	// Without detected boards one may appear anywhere, so watch the whole image
+	std::vector< cv::Rect > full_image;
+	if(gateRegions.empty())
+	{
+		full_image.push_back(cv::Rect(cv::Point(0, 0), gateDifference.size()));
+	}
+	std::vector< cv::Rect > const& regions = gateRegions.empty() ? full_image : gateRegions;
+
+	int64_t changed_pixels = 0;
+	int64_t watched_pixels = 0;
+	for(cv::Rect const& region : regions)
+	{
+		changed_pixels += cv::countNonZero(gateDifference(region));
+		watched_pixels += region.area();
+	}
+
+	return watched_pixels > 0 && changed_pixels <= gatingChangeThreshold * watched_pixels;
+}
+
+void FiducialTracker::updateGateReference()
+{
+	// gateCurrent was computed for this frame by canReuseDetection
+	std::swap(gateReference, gateCurrent);
+
+	framesSinceDetection = 0;
+	forceDetection = false;
+
+	const cv::Rect full_region(cv::Point(0, 0), gateReference.size());
+	gateRegions.clear();
+	for(std::vector< cv::Point2f > const& corners : lastMarkerCorners)
+	{
+		cv::Rect region = cv::boundingRect(corners);
+		region = cv::Rect(
+			region.x / GATE_DOWNSAMPLE - GATE_REGION_MARGIN,
+			region.y / GATE_DOWNSAMPLE - GATE_REGION_MARGIN,
+			region.width / GATE_DOWNSAMPLE + 2 * GATE_REGION_MARGIN,
+			region.height / GATE_DOWNSAMPLE + 2 * GATE_REGION_MARGIN
+		) & full_region;
+
+		if(region.area() > 0)
+		{
+			gateRegions.push_back(region);
+		}
+	}
+}
+
+void FiducialTracker::collectDiagnostics(std::vector< std::vector< cv::Point2f > > const& corners, std::vector< int32_t > const& ids, cv::Size const& image_size)
+{
+	frameDiagnostics.clear();
+	frameDiagnostics.imageSize = image_size;
+	frameDiagnostics.markerCorners = corners;
+	frameDiagnostics.markerIds = ids;
+	frameDiagnostics.reprojectedCorners.resize(ids.size());
+
+	for(TrackedPose* pose : detectedPoses)
+	{
+		cv::Ptr<cv::aruco::Board> const board = pose->pattern->getBoard();
+
+		cv::Mat_<double> rotation_axis_angle;
+		cv::Rodrigues(pose->getRotationMat(), rotation_axis_angle);
+
+		// Axes as long as the side of the board's first marker
+		std::vector< cv::Point3f > const& first_marker = board->objPoints[0];
+		const float axis_length = float(cv::norm(first_marker[1] - first_marker[0]));
+		const std::vector< cv::Point3f > axis_points = {
+			cv::Point3f(0, 0, 0),
+			cv::Point3f(axis_length, 0, 0),
+			cv::Point3f(0, axis_length, 0),
+			cv::Point3f(0, 0, axis_length)
+		};
+		std::vector< cv::Point2f > axis_image_points;
+		cv::projectPoints(axis_points, rotation_axis_angle, pose->getTranslation(), cameraIntrinsicMat, cameraDistortion, axis_image_points);
+
+		FrameDiagnostics::BoardAxes axes;
+		axes.poseId = pose->getPoseId();
+		axes.origin = axis_image_points[0];
+		for(int32_t axis : {0, 1, 2})
+		{
+			axes.axisEnds[axis] = axis_image_points[axis + 1];
+		}
+
+		// Residuals of the markers which belong to this board
+		double error_sum = 0;
+		int32_t error_count = 0;
+		for(size_t mk_idx = 0; mk_idx < ids.size(); mk_idx++)
+		{
+			auto pose_iter = posesByMarker.find(ids[mk_idx]);
+			auto board_iter = std::find(board->ids.begin(), board->ids.end(), ids[mk_idx]);
+			if(pose_iter == posesByMarker.end() || pose_iter->second != pose || board_iter == board->ids.end())
+			{
+				continue;
+			}
+
+			std::vector< cv::Point2f >& reprojected = frameDiagnostics.reprojectedCorners[mk_idx];
+			cv::projectPoints(board->objPoints[board_iter - board->ids.begin()], rotation_axis_angle, pose->getTranslation(),
+				cameraIntrinsicMat, cameraDistortion, reprojected);
+
+			for(size_t corner_idx = 0; corner_idx < reprojected.size() && corner_idx < corners[mk_idx].size(); corner_idx++)
+			{
+				error_sum += cv::norm(reprojected[corner_idx] - corners[mk_idx][corner_idx]);
+				error_count++;
+			}
+		}
+		axes.reprojectionError = error_count > 0 ? float(error_sum / error_count) : 0.0f;
+
+		frameDiagnostics.boards.push_back(axes);
+	}
+}
+
 std::unordered_set<TrackedPose*> const& FiducialTracker::getDetectedPoses() const
 {
 	return detectedPoses;
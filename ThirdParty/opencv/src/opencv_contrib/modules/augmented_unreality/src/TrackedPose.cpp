@@ -33,6 +33,7 @@ TrackedPose::TrackedPose(FiducialTracker* tracker_ptr, cv::Ptr<FiducialPattern>
 	, pattern(pattern_def)
 	, poseId(pattern_def->getMinMarkerId())
 	, Translation(3, 1)
+	, numFoundMarkers(0)
 {
 }
 
@@ -54,6 +55,9 @@ void TrackedPose::addFoundMarker(int32_t id, std::vector< cv::Point2f>& detected
 
 bool TrackedPose::determinePose()
 {
+	numFoundMarkers = int32_t(foundMarkerIds.size());
+	chessboardCorners.clear();
+	chessboardCornerIds.clear();
 	bool success = pattern->determinePose(this);
 	clearFound();
 	return success;